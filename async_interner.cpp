@@ -0,0 +1,152 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "async_interner.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+namespace utils {
+
+// Queued string request.
+struct async_interner::request_t {
+    request_t* next = nullptr;
+    std::string str;
+    std::promise<string> result;
+};
+
+async_interner::async_interner(literal_dictionary& dict)
+    : dict_(dict), thread_([this] { run(); }) {
+}
+
+async_interner::~async_interner() {
+    stop();
+}
+
+// Stop interner thread, queued strings are added before.
+void async_interner::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        stop_.store(true);
+    }
+    wake_cv_.notify_one();
+    if(thread_.joinable())
+        thread_.join();
+    // Request pushed after interner thread's last check is drained here,
+    // or by its submitter seeing stop flag.
+    drain();
+}
+
+// Find or add string without waiting for dictionary locks.
+async_interner::result async_interner::add(string_view str) {
+    // Strings are added immediately after stop.
+    std::optional<string> found;
+    if(stop_.load())
+        found = dict_.add(str);
+    else
+        found = dict_.try_add(str);
+    if(found)
+        return result(*found);
+    auto* request = new request_t;
+    request->str.assign(str.data(), str.size());
+    auto future = request->result.get_future();
+    submitted_.fetch_add(1);
+    push(request);
+    // Either stopping thread drains the queue after setting stop flag, or
+    // pushed request is seen by this check (both are sequentially
+    // consistent), so the request is never left in stopped queue.
+    if(stop_.load())
+        drain();
+    return result(std::move(future));
+}
+
+// Wait until strings queued before the call are added.
+void async_interner::flush() {
+    auto submitted = submitted_.load();
+    std::unique_lock<std::mutex> lock(mtx_);
+    done_cv_.wait(lock, [&] { return completed_.load() >= submitted; });
+}
+
+// Push request to queue head (lock-free).
+void async_interner::push(request_t* request) {
+    auto* head = head_.load(std::memory_order_relaxed);
+    do {
+        request->next = head;
+    } while(!head_.compare_exchange_weak(
+        head, request, std::memory_order_seq_cst, std::memory_order_relaxed));
+    if(head != nullptr)
+        return;
+    // Interner thread checks queue under lock before sleeping, so the
+    // notification can't be lost.
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+    }
+    wake_cv_.notify_one();
+}
+
+// Interner thread loop, queued strings are added before stop.
+void async_interner::run() {
+    for(;;) {
+        auto* requests = head_.exchange(nullptr, std::memory_order_acquire);
+        if(requests != nullptr) {
+            add_batch(requests);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mtx_);
+        // Requests pushed after the exchange are added before stop.
+        if(stop_.load() && head_.load() == nullptr)
+            break;
+        wake_cv_.wait(lock, [this] {
+            return stop_.load() || head_.load() != nullptr;
+        });
+    }
+}
+
+// Add whole queue by current thread (after stop).
+void async_interner::drain() {
+    if(auto* requests = head_.exchange(nullptr))
+        add_batch(requests);
+}
+
+// Add requests (newest first) as one dictionary batch.
+void async_interner::add_batch(request_t* requests) {
+    std::vector<request_t*> batch;
+    for(; requests != nullptr; requests = requests->next)
+        batch.push_back(requests);
+    std::reverse(batch.begin(), batch.end());
+    std::vector<string_view> strs;
+    strs.reserve(batch.size());
+    for(auto* request : batch)
+        strs.push_back(request->str);
+    std::vector<string> result(batch.size());
+    bool added = true;
+    try {
+        dict_.add_many(strs.data(), strs.size(), result.data());
+    } catch(...) {
+        added = false;
+    }
+    for(size_t i = 0; i < batch.size(); ++i) {
+        if(added) {
+            batch[i]->result.set_value(result[i]);
+            continue;
+        }
+        // Strings are added one by one to fail their requests only.
+        try {
+            batch[i]->result.set_value(dict_.add(strs[i]));
+        } catch(...) {
+            batch[i]->result.set_exception(std::current_exception());
+        }
+    }
+    for(auto* request : batch)
+        delete request;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        completed_.fetch_add(batch.size());
+    }
+    done_cv_.notify_all();
+}
+
+} // namespace utils
@@ -0,0 +1,118 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Deferred string interning for latency sensitive threads.
+//
+// Strings found in dictionary (or added without waiting for locks) are
+// returned immediately, other ones are copied to lock-free MPSC queue
+// and added by background interner thread in batches (each insertion
+// lock and table growth are taken once per batch).
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <variant>
+
+#include "shared_string.hpp"
+
+namespace utils {
+
+class async_interner {
+    struct request_t;
+
+public:
+    using string = literal_dictionary::string;
+
+    // Add result: string available immediately (no allocation) or future
+    // set by interner thread.
+    class result {
+    public:
+        explicit result(string str) : value_(std::move(str)) {}
+        explicit result(std::future<string> future)
+            : value_(std::move(future)) {}
+
+        // String was queued to interner thread.
+        bool queued() const noexcept { return value_.index() != 0; }
+
+        // String is available without waiting.
+        bool ready() const {
+            const auto* future = std::get_if<1>(&value_);
+            return future == nullptr
+                || future->wait_for(std::chrono::seconds(0))
+                == std::future_status::ready;
+        }
+
+        // Get string, waits for interner thread if string is queued.
+        string get() {
+            if(auto* future = std::get_if<1>(&value_))
+                value_ = future->get();
+            return std::get<0>(value_);
+        }
+
+    private:
+        std::variant<string, std::future<string>> value_;
+    };
+
+    // Start interner thread for dictionary.
+    explicit async_interner(
+        literal_dictionary& dict = literal_dictionary::global());
+    // Stops interner thread (see stop).
+    ~async_interner();
+
+    async_interner(const async_interner&) = delete;
+    async_interner& operator=(const async_interner&) = delete;
+
+    // Find or add string, never waits for dictionary locks: result holds
+    // string if it is available immediately, otherwise string copy is
+    // queued and result is set by interner thread.
+    result add(string_view str);
+
+    // Wait until strings queued before the call are added.
+    void flush();
+
+    // Stop interner thread: strings queued before are added first, and
+    // strings submitted while stopping or after are added by submitting
+    // thread, so every result is eventually set. Call from one thread.
+    void stop();
+
+    // Number of queued strings not yet added.
+    size_t pending() const noexcept {
+        // Completed count never exceeds previously submitted one.
+        auto completed = completed_.load();
+        return submitted_.load() - completed;
+    }
+
+private:
+    // Push request to queue head (lock-free), wakes up interner thread
+    // when queue was empty.
+    void push(request_t* request);
+
+    // Interner thread: takes the whole queue and adds it as one batch.
+    void run();
+    void add_batch(request_t* requests);
+
+    // Add whole queue by current thread (after stop).
+    void drain();
+
+private:
+    literal_dictionary& dict_;
+    // Requests stack (newest first), taken by interner thread at once.
+    std::atomic<request_t*> head_{nullptr};
+    std::atomic<size_t> submitted_{0};
+    std::atomic<size_t> completed_{0};
+    // Interner thread wake up and flush notifications.
+    std::mutex mtx_;
+    std::condition_variable wake_cv_;
+    std::condition_variable done_cv_;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+} // namespace utils
@@ -0,0 +1,374 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "counted_dict_string.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "dictionary_registry.hpp"
+
+namespace utils {
+
+// Reader record, padded to separate cache lines.
+struct alignas(64) counted_dictionary::reader_t {
+    // Entered epoch, 0 if no lookup is in progress.
+    std::atomic<uint64_t> epoch{0};
+    // Record is cached by a thread (released records are reused).
+    std::atomic<bool> owned{true};
+    reader_t* next = nullptr;
+};
+
+namespace {
+
+// Live dictionaries, reader records of thread cache slots are released
+// only for live ones.
+using dictionary_registry = bits::instance_registry<counted_dictionary>;
+
+// Size classes below small_class_limit are 16 bytes steps.
+constexpr size_t small_class_step = 16;
+constexpr size_t small_class_limit = 256;
+constexpr size_t small_class_count = small_class_limit / small_class_step;
+
+inline size_t ceil_log2(size_t x) {
+    size_t n = 0;
+    while((size_t(1) << n) < x)
+        ++n;
+    return n;
+}
+
+// Size class of node with allocation size.
+inline size_t size_class(size_t size) {
+    if(size <= small_class_limit)
+        return (size - 1) / small_class_step;
+    return small_class_count + ceil_log2(size) - ceil_log2(small_class_limit)
+        - 1;
+}
+
+// Allocation size of size class.
+inline size_t class_size(size_t size_class) {
+    if(size_class < small_class_count)
+        return (size_class + 1) * small_class_step;
+    return small_class_limit << (size_class - small_class_count + 1);
+}
+
+// Stripe number and stripe bucket number for hash.
+inline size_t stripe_index(uint64_t hash) {
+    return static_cast<size_t>(hash % counted_dictionary::stripe_count);
+}
+inline size_t stripe_bucket_index(uint64_t hash, size_t bucket_count) {
+    return static_cast<size_t>(
+        (hash / counted_dictionary::stripe_count) & (bucket_count - 1));
+}
+
+} // namespace
+
+// Release cached reader record (if its dictionary is still alive).
+struct counted_dictionary::thread_reader_release {
+    bool operator()(uint64_t dict_id, reader_t* reader, bool wait) const {
+        return dictionary_registry::visit(
+            dict_id, wait, [reader](counted_dictionary*) {
+                reader->owned.store(false);
+                return true;
+            });
+    }
+};
+
+// Thread local reader cache for a few dictionaries.
+struct counted_dictionary::thread_reader_cache
+    : bits::thread_instance_cache<reader_t*, thread_reader_release> {};
+
+thread_local counted_dictionary::thread_reader_cache
+    counted_dictionary::thread_readers_;
+
+counted_dictionary::counted_dictionary()
+    : counted_dictionary(literal_dictionary::options{}) {
+}
+
+counted_dictionary::counted_dictionary(
+    const literal_dictionary::options& opts, pmr::memory_resource* mem)
+    : mem_{mem}
+    , key_policy_{opts.keys}
+    , chunk_size_{std::max(
+          opts.allocate_chunk_size,
+          literal_dictionary::min_allocate_chunk_size)}
+    , initial_bucket_count_{std::max<size_t>(
+          size_t(1) << ceil_log2(opts.table_initial_size / stripe_count),
+          8)}
+    , instance_id_{bits::next_instance_id()} {
+    dictionary_registry::add(instance_id_, this);
+}
+
+counted_dictionary::~counted_dictionary() {
+    // Reader records cached by threads are not released after that.
+    dictionary_registry::remove(instance_id_);
+    for(auto& stripe : stripes_) {
+        if(auto* table = stripe.table.load(std::memory_order_relaxed)) {
+            table->next = stripe.retired.tables;
+            stripe.retired.tables = table;
+        }
+        free_retired(stripe, stripe.retired);
+        free_retired(stripe, stripe.sealed);
+        while(stripe.pages != nullptr) {
+            auto* next = stripe.pages->next;
+            mem_->deallocate(
+                stripe.pages, chunk_size_, std::alignment_of<node_t>::value);
+            stripe.pages = next;
+        }
+    }
+    auto* reader = readers_.load(std::memory_order_relaxed);
+    while(reader != nullptr) {
+        auto* next = reader->next;
+        reader->~reader_t();
+        mem_->deallocate(
+            reader, sizeof(reader_t), std::alignment_of<reader_t>::value);
+        reader = next;
+    }
+}
+
+// Find or add string.
+counted_dict_string counted_dictionary::add(string_view str) {
+    if(str.size() > max_string_size())
+        throw std::runtime_error("dictionary dict_string to big");
+    bits::normalized_key key(key_policy_, str);
+    str = key.str();
+    auto hash = dict_hash(str);
+    auto& stripe = stripes_[stripe_index(hash)];
+    if(auto* node = acquire_node(stripe, hash, str))
+        return {this, node};
+    std::lock_guard<std::mutex> lock(stripe.mtx);
+    // Added by other thread after lookup.
+    if(auto* node = find_node(stripe.table.load(), hash, str))
+        return {this, node};
+    auto* table = stripe.table.load(std::memory_order_relaxed);
+    if(table == nullptr || stripe.size >= table->bucket_count)
+        table = grow_stripe(stripe);
+    auto* node = allocate_node(stripe, sizeof(node_t) + str.size() + 1);
+    node->hash = hash;
+    node->refs.store(1, std::memory_order_relaxed);
+    node->size = static_cast<uint32_t>(str.size());
+    auto* data = reinterpret_cast<char*>(node + 1);
+    std::memcpy(data, str.data(), str.size());
+    data[str.size()] = '\0';
+    auto& bucket =
+        table->buckets()[stripe_bucket_index(hash, table->bucket_count)];
+    node->next.store(bucket.load(), std::memory_order_relaxed);
+    bucket.store(node);
+    ++stripe.size;
+    size_.fetch_add(1, std::memory_order_relaxed);
+    return {this, node};
+}
+
+// Find string (never adds).
+std::optional<counted_dict_string> counted_dictionary::find(string_view str) {
+    bits::normalized_key key(key_policy_, str);
+    auto hash = dict_hash(key.str());
+    if(auto* node = acquire_node(stripes_[stripe_index(hash)], hash, key.str()))
+        return counted_dict_string{this, node};
+    return std::nullopt;
+}
+
+// Find node and add its reference without stripe lock.
+// Nodes and tables seen by lookup are not reused until it leaves
+// (reader record holds entered epoch). Table growth relinks nodes,
+// lookup overlapping it is repeated under stripe lock.
+counted_dictionary::node_t* counted_dictionary::acquire_node(
+    stripe_t& stripe, uint64_t hash, string_view str) {
+    auto* reader = thread_reader();
+    reader->epoch.store(epoch_.load());
+    auto seq = stripe.growth_seq.load();
+    auto* node = find_node(stripe.table.load(), hash, str);
+    auto complete = node != nullptr
+        || ((seq & 1) == 0 && stripe.growth_seq.load() == seq);
+    reader->epoch.store(0, std::memory_order_release);
+    if(complete)
+        return node;
+    std::lock_guard<std::mutex> lock(stripe.mtx);
+    return find_node(stripe.table.load(), hash, str);
+}
+
+// Find node in table and add its reference.
+// Nodes without references are being released and never acquired again
+// (their releaser removes them), new node is added instead.
+counted_dictionary::node_t* counted_dictionary::find_node(
+    bucket_table_t* table, uint64_t hash, string_view str) noexcept {
+    if(table == nullptr)
+        return nullptr;
+    auto* node =
+        table->buckets()[stripe_bucket_index(hash, table->bucket_count)]
+            .load();
+    for(; node != nullptr; node = node->next.load()) {
+        if(node->hash != hash || !bits::equal(node->str(), str))
+            continue;
+        // Increment only if nonzero.
+        auto refs = node->refs.load(std::memory_order_relaxed);
+        while(refs != 0) {
+            if(node->refs.compare_exchange_weak(
+                   refs, refs + 1, std::memory_order_relaxed))
+                return node;
+        }
+    }
+    return nullptr;
+}
+
+// Free retired nodes and tables no lookup may see, requires stripe lock.
+// Retired batch is sealed by advancing global epoch: lookups entering
+// the new epoch can't reach it, so it is freed once no lookup is left in
+// older epochs. Later retirements go to the next batch, so continuous
+// lookups delay reclamation only by their own duration.
+void counted_dictionary::reclaim(stripe_t& stripe) noexcept {
+    if(!stripe.sealed.empty()) {
+        if(min_reader_epoch() < stripe.sealed.epoch)
+            return;
+        free_retired(stripe, stripe.sealed);
+    }
+    if(stripe.retired.empty())
+        return;
+    stripe.sealed = stripe.retired;
+    stripe.retired = retired_t();
+    stripe.sealed.epoch = epoch_.fetch_add(1) + 1;
+    if(min_reader_epoch() >= stripe.sealed.epoch)
+        free_retired(stripe, stripe.sealed);
+}
+
+// Move batch nodes to free lists and free its tables.
+void counted_dictionary::free_retired(
+    stripe_t& stripe, retired_t& batch) noexcept {
+    while(auto* node = batch.nodes) {
+        batch.nodes = node->free_next;
+        auto& free_list =
+            stripe.free_lists[size_class(sizeof(node_t) + node->size + 1)];
+        node->free_next = free_list;
+        free_list = node;
+    }
+    while(auto* table = batch.tables) {
+        batch.tables = table->next;
+        mem_->deallocate(
+            table, table_size(table->bucket_count),
+            std::alignment_of<bucket_table_t>::value);
+    }
+}
+
+// Minimal epoch of lookups in progress.
+uint64_t counted_dictionary::min_reader_epoch() const noexcept {
+    auto min_epoch = ~uint64_t(0);
+    for(auto* reader = readers_.load(); reader != nullptr;
+        reader = reader->next) {
+        auto epoch = reader->epoch.load();
+        if(epoch != 0)
+            min_epoch = std::min(min_epoch, epoch);
+    }
+    return min_epoch;
+}
+
+// Get reader record of current thread.
+// Released record is taken or new one is pushed to records list (records
+// are never removed, so the list is scanned without lock).
+counted_dictionary::reader_t* counted_dictionary::thread_reader() {
+    auto& cache = thread_readers_;
+    if(auto* reader = cache.find(instance_id_))
+        return *reader;
+    cache.evict();
+    auto* head = readers_.load();
+    for(auto* reader = head; reader != nullptr; reader = reader->next) {
+        bool owned = false;
+        if(!reader->owned.load(std::memory_order_relaxed)
+           && reader->owned.compare_exchange_strong(owned, true)) {
+            cache.insert(instance_id_) = reader;
+            return reader;
+        }
+    }
+    auto* reader = new(mem_->allocate(
+        sizeof(reader_t), std::alignment_of<reader_t>::value)) reader_t();
+    reader->next = head;
+    while(!readers_.compare_exchange_weak(head, reader))
+        reader->next = head;
+    cache.insert(instance_id_) = reader;
+    return reader;
+}
+
+// Allocate node from stripe free lists or pages, requires stripe lock.
+counted_dictionary::node_t* counted_dictionary::allocate_node(
+    stripe_t& stripe, size_t node_size) {
+    reclaim(stripe);
+    auto cls = size_class(node_size);
+    if(auto* node = stripe.free_lists[cls]) {
+        stripe.free_lists[cls] = node->free_next;
+        return node;
+    }
+    // Large classes are limited by chunk size.
+    auto size = std::min(class_size(cls), chunk_size_ - sizeof(page_t));
+    if(stripe.remain_page_size < size) {
+        auto* page = static_cast<page_t*>(
+            mem_->allocate(chunk_size_, std::alignment_of<node_t>::value));
+        page->next = stripe.pages;
+        stripe.pages = page;
+        stripe.current_page = reinterpret_cast<char*>(page + 1);
+        stripe.remain_page_size = chunk_size_ - sizeof(page_t);
+    }
+    auto* node = new(stripe.current_page) node_t;
+    stripe.current_page += size;
+    stripe.remain_page_size -= size;
+    return node;
+}
+
+// Grow stripe hashtable, requires stripe lock.
+// Replaced table is retired, lookups may still read it.
+counted_dictionary::bucket_table_t* counted_dictionary::grow_stripe(
+    stripe_t& stripe) {
+    auto* old_table = stripe.table.load(std::memory_order_relaxed);
+    auto bucket_count = old_table != nullptr ? old_table->bucket_count * 2
+                                             : initial_bucket_count_;
+    auto* table = static_cast<bucket_table_t*>(mem_->allocate(
+        table_size(bucket_count), std::alignment_of<bucket_table_t>::value));
+    table->bucket_count = bucket_count;
+    table->next = nullptr;
+    auto* buckets = table->buckets();
+    for(size_t i = 0; i < bucket_count; ++i)
+        new(buckets + i) std::atomic<node_t*>(nullptr);
+    if(old_table == nullptr) {
+        stripe.table.store(table);
+        return table;
+    }
+    auto seq = stripe.growth_seq.load(std::memory_order_relaxed);
+    stripe.growth_seq.store(seq + 1);
+    for(size_t i = 0; i < old_table->bucket_count; ++i) {
+        auto* node = old_table->buckets()[i].load(std::memory_order_relaxed);
+        while(node != nullptr) {
+            auto* next = node->next.load(std::memory_order_relaxed);
+            auto& bucket =
+                buckets[stripe_bucket_index(node->hash, bucket_count)];
+            node->next.store(bucket.load(std::memory_order_relaxed));
+            bucket.store(node, std::memory_order_relaxed);
+            node = next;
+        }
+    }
+    stripe.table.store(table);
+    stripe.growth_seq.store(seq + 2);
+    old_table->next = stripe.retired.tables;
+    stripe.retired.tables = old_table;
+    return table;
+}
+
+// Remove node without references, called once by the last string owner.
+// Node is retired, lookups may still read it.
+void counted_dictionary::release(node_t* node) noexcept {
+    auto& stripe = stripes_[stripe_index(node->hash)];
+    std::lock_guard<std::mutex> lock(stripe.mtx);
+    auto* table = stripe.table.load(std::memory_order_relaxed);
+    auto* link =
+        &table->buckets()[stripe_bucket_index(node->hash, table->bucket_count)];
+    while(link->load(std::memory_order_relaxed) != node)
+        link = &link->load(std::memory_order_relaxed)->next;
+    link->store(node->next.load(std::memory_order_relaxed));
+    --stripe.size;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    node->free_next = stripe.retired.nodes;
+    stripe.retired.nodes = node;
+    reclaim(stripe);
+}
+
+} // namespace utils
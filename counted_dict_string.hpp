@@ -0,0 +1,287 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Reference counted dictionary strings.
+//
+// Counted strings are stored in own striped hashtable (separate from
+// immortal literal_dictionary strings), each stripe has its own lock,
+// bucket chains, memory pages and size class free lists. Node is removed
+// when the last string referencing it is destroyed, and its memory is
+// reused by strings of the same size class once no lookup can see it.
+//
+// Lookups don't take stripe locks (bucket chains are atomic), insertion
+// and removal do. Removed nodes are reclaimed by epochs: each thread
+// publishes epoch of its lookup in own reader record.
+//
+// Copies only change node reference count, the table is accessed on
+// string addition and removal only.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <optional>
+
+#include "shared_string.hpp"
+
+namespace utils {
+
+class counted_dict_string;
+
+// Dictionary of reference counted strings.
+class counted_dictionary {
+    friend class counted_dict_string;
+
+    struct reader_t;
+    struct thread_reader_release;
+    struct thread_reader_cache;
+
+    // Counted string node, string (null-terminated) is placed after header.
+    struct node_t {
+        // Bucket chain link.
+        std::atomic<node_t*> next;
+        // Retired or free list link (chain link stays for lookups).
+        node_t* free_next;
+        uint64_t hash;
+        std::atomic<uint32_t> refs;
+        uint32_t size;
+        const char* data() const {
+            return reinterpret_cast<const char*>(this + 1);
+        }
+        string_view str() const {
+            return {data(), size};
+        }
+    };
+
+    // Allocated memory chunk header.
+    struct page_t {
+        page_t* next;
+    };
+
+    // Stripe bucket table header, buckets are placed after it.
+    struct bucket_table_t {
+        size_t bucket_count;
+        // Next retired table.
+        bucket_table_t* next;
+        std::atomic<node_t*>* buckets() noexcept {
+            return reinterpret_cast<std::atomic<node_t*>*>(this + 1);
+        }
+    };
+
+    static size_t table_size(size_t bucket_count) noexcept {
+        return sizeof(bucket_table_t)
+            + bucket_count * sizeof(std::atomic<node_t*>);
+    }
+
+public:
+    // Number of lock stripes.
+    static constexpr size_t stripe_count = 64;
+
+    // Node size classes: 16 bytes steps up to 256 bytes,
+    // powers of two for larger nodes (up to uint32_t string sizes).
+    static constexpr size_t size_class_count = 48;
+
+    counted_dictionary();
+    explicit counted_dictionary(
+        const literal_dictionary::options& opts,
+        pmr::memory_resource* mem = pmr::get_default_resource());
+    ~counted_dictionary();
+
+    counted_dictionary(const counted_dictionary&) = delete;
+    counted_dictionary& operator=(const counted_dictionary&) = delete;
+
+    // Strings size limit (should fit in memory chunk).
+    size_t max_string_size() const noexcept {
+        return std::min<size_t>(
+            chunk_size_ - sizeof(page_t) - sizeof(node_t) - 1, UINT32_MAX);
+    }
+
+    // Find or add string.
+    counted_dict_string add(string_view str);
+
+    // Find string (never adds).
+    std::optional<counted_dict_string> find(string_view str);
+
+    // Number of referenced strings.
+    size_t size() const noexcept {
+        return size_.load();
+    }
+
+private:
+    // Removed nodes and replaced tables lookups may still see.
+    struct retired_t {
+        node_t* nodes = nullptr;
+        bucket_table_t* tables = nullptr;
+        // Epoch following retirement of sealed batch.
+        uint64_t epoch = 0;
+        bool empty() const noexcept {
+            return nodes == nullptr && tables == nullptr;
+        }
+    };
+
+    // Lock stripe: hashtable part with own memory.
+    struct alignas(64) stripe_t {
+        std::mutex mtx;
+        std::atomic<bucket_table_t*> table{nullptr};
+        // Odd while table grows, advanced by each growth.
+        std::atomic<size_t> growth_seq{0};
+        size_t size = 0;
+        page_t* pages = nullptr;
+        char* current_page = nullptr;
+        size_t remain_page_size = 0;
+        std::array<node_t*, size_class_count> free_lists{};
+        // Batch collecting retired ones and batch waiting for lookups.
+        retired_t retired;
+        retired_t sealed;
+    };
+
+    // Find node and add its reference without stripe lock.
+    node_t* acquire_node(stripe_t& stripe, uint64_t hash, string_view str);
+
+    // Find node in table and add its reference.
+    static node_t* find_node(
+        bucket_table_t* table, uint64_t hash, string_view str) noexcept;
+
+    // Free retired nodes and tables no lookup may see,
+    // requires stripe lock.
+    void reclaim(stripe_t& stripe) noexcept;
+
+    // Move batch nodes to free lists and free its tables.
+    void free_retired(stripe_t& stripe, retired_t& batch) noexcept;
+
+    // Minimal epoch of lookups in progress (max value if none).
+    uint64_t min_reader_epoch() const noexcept;
+
+    // Get reader record of current thread.
+    reader_t* thread_reader();
+
+    static thread_local thread_reader_cache thread_readers_;
+
+    // Allocate node from stripe free lists or pages, requires stripe lock.
+    node_t* allocate_node(stripe_t& stripe, size_t node_size);
+
+    // Grow stripe hashtable, requires stripe lock.
+    bucket_table_t* grow_stripe(stripe_t& stripe);
+
+    // Remove node without references.
+    void release(node_t* node) noexcept;
+
+private:
+    pmr::memory_resource* mem_;
+    const literal_dictionary::key_policy key_policy_;
+    const size_t chunk_size_;
+    const size_t initial_bucket_count_;
+    std::atomic<size_t> size_{0};
+    // Global epoch (starts from 1, 0 means inactive reader).
+    std::atomic<uint64_t> epoch_{1};
+    // Unique dictionary instance id (thread reader cache key).
+    const uint64_t instance_id_;
+    // Reader records (released ones are reused).
+    std::atomic<reader_t*> readers_{nullptr};
+    std::array<stripe_t, stripe_count> stripes_;
+};
+
+// Reference counted dictionary string.
+class counted_dict_string {
+    friend class counted_dictionary;
+    using node_t = counted_dictionary::node_t;
+
+    // Takes ownership of node reference.
+    counted_dict_string(counted_dictionary* dict, node_t* node) noexcept
+        : dict_(dict), node_(node) {
+    }
+
+public:
+    using size_type = string_view::size_type;
+
+    counted_dict_string() noexcept = default;
+    counted_dict_string(const counted_dict_string& rhs) noexcept
+        : dict_(rhs.dict_), node_(rhs.node_) {
+        if(node_ != nullptr)
+            node_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    counted_dict_string(counted_dict_string&& rhs) noexcept
+        : dict_(rhs.dict_), node_(rhs.node_) {
+        rhs.node_ = nullptr;
+    }
+    ~counted_dict_string() {
+        reset();
+    }
+    counted_dict_string& operator=(counted_dict_string rhs) noexcept {
+        std::swap(dict_, rhs.dict_);
+        std::swap(node_, rhs.node_);
+        return *this;
+    }
+    void reset() noexcept {
+        if(node_ != nullptr
+           && node_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            dict_->release(node_);
+        node_ = nullptr;
+    }
+    size_t hash() const noexcept {
+        return node_ != nullptr ? node_->hash : dict_hash(string_view());
+    }
+    const char* data() const noexcept {
+        return node_ != nullptr ? node_->data()
+                                : literal_dictionary::empty_str();
+    }
+    const char* c_str() const noexcept {
+        return data();
+    }
+    size_type size() const noexcept {
+        return node_ != nullptr ? node_->size : 0;
+    }
+    bool empty() const noexcept {
+        return size() == 0;
+    }
+    string_view ref() const noexcept {
+        return {data(), size()};
+    }
+    operator string_view() const noexcept {
+        return ref();
+    }
+    // Number of strings referencing the same node.
+    size_t use_count() const noexcept {
+        return node_ != nullptr ? node_->refs.load() : 0;
+    }
+    // Identity check, valid for strings from the same dictionary only.
+    bool identical(const counted_dict_string& rhs) const noexcept {
+        return node_ == rhs.node_;
+    }
+
+private:
+    counted_dictionary* dict_ = nullptr;
+    node_t* node_ = nullptr;
+};
+
+inline bool operator==(
+    const counted_dict_string& lhs, const counted_dict_string& rhs) noexcept {
+    return lhs.identical(rhs)
+        || (lhs.hash() == rhs.hash() && bits::equal(lhs.ref(), rhs.ref()));
+}
+inline bool operator!=(
+    const counted_dict_string& lhs, const counted_dict_string& rhs) noexcept {
+    return !(lhs == rhs);
+}
+inline bool operator==(
+    const counted_dict_string& lhs, const string_view& rhs) noexcept {
+    return bits::equal(lhs.ref(), rhs);
+}
+inline bool operator!=(
+    const counted_dict_string& lhs, const string_view& rhs) noexcept {
+    return !bits::equal(lhs.ref(), rhs);
+}
+
+} // namespace utils
+
+namespace std {
+template<>
+struct hash<utils::counted_dict_string> {
+    size_t operator()(const utils::counted_dict_string& v) const {
+        return v.hash();
+    }
+};
+} // namespace std
@@ -0,0 +1,290 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Flat hash map keyed by dict_string.
+//
+// Open addressing table with linear probing. Slots keep key hash, so
+// probing and rehashing don't touch dictionary nodes, and keys are
+// compared by identity (keys should be from the same dictionary).
+// Lookup by string_view compares hash and content and never adds the
+// string to dictionary.
+
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "shared_string.hpp"
+
+namespace utils {
+
+template<class T>
+class dict_string_map {
+public:
+    using key_type = dict_string;
+    using mapped_type = T;
+    using value_type = std::pair<const dict_string, T>;
+    using size_type = size_t;
+
+private:
+    struct slot_t {
+        size_t hash = 0;
+        std::optional<value_type> value;
+    };
+    using slots_t = std::vector<slot_t>;
+
+    static constexpr size_t npos = ~size_t(0);
+    static constexpr size_t min_capacity = 16;
+
+    template<class Map, class Value>
+    class basic_iterator {
+        friend class dict_string_map;
+        basic_iterator(Map* map, size_t pos) : map_(map), pos_(pos) {
+            skip_empty();
+        }
+
+    public:
+        basic_iterator() = default;
+        // Mutable iterator is convertible to const one.
+        template<class OtherMap, class OtherValue>
+        basic_iterator(const basic_iterator<OtherMap, OtherValue>& rhs)
+            : map_(rhs.map_), pos_(rhs.pos_) {
+        }
+        Value& operator*() const {
+            return *map_->slots_[pos_].value;
+        }
+        Value* operator->() const {
+            return &*map_->slots_[pos_].value;
+        }
+        basic_iterator& operator++() {
+            ++pos_;
+            skip_empty();
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+        bool operator==(const basic_iterator& rhs) const {
+            return pos_ == rhs.pos_;
+        }
+        bool operator!=(const basic_iterator& rhs) const {
+            return pos_ != rhs.pos_;
+        }
+
+    private:
+        template<class, class>
+        friend class basic_iterator;
+
+        void skip_empty() {
+            while(pos_ < map_->slots_.size() && !map_->slots_[pos_].value)
+                ++pos_;
+        }
+
+        Map* map_ = nullptr;
+        size_t pos_ = 0;
+    };
+
+public:
+    using iterator = basic_iterator<dict_string_map, value_type>;
+    using const_iterator =
+        basic_iterator<const dict_string_map, const value_type>;
+
+    dict_string_map() = default;
+    explicit dict_string_map(size_t capacity) {
+        reserve(capacity);
+    }
+
+    size_t size() const noexcept {
+        return size_;
+    }
+    bool empty() const noexcept {
+        return size_ == 0;
+    }
+    size_t bucket_count() const noexcept {
+        return slots_.size();
+    }
+
+    iterator begin() {
+        return {this, 0};
+    }
+    iterator end() {
+        return {this, slots_.size()};
+    }
+    const_iterator begin() const {
+        return {this, 0};
+    }
+    const_iterator end() const {
+        return {this, slots_.size()};
+    }
+
+    void clear() {
+        slots_.clear();
+        size_ = 0;
+    }
+
+    // Reserve slots for count elements (load factor is kept under 3/4).
+    void reserve(size_t count) {
+        size_t capacity = min_capacity;
+        while(capacity * 3 < count * 4)
+            capacity <<= 1;
+        if(capacity > slots_.size())
+            rehash(capacity);
+    }
+
+    iterator find(const dict_string& key) {
+        return {this, find_pos(key)};
+    }
+    const_iterator find(const dict_string& key) const {
+        return {this, find_pos(key)};
+    }
+    iterator find(string_view key) {
+        return {this, find_pos(key)};
+    }
+    const_iterator find(string_view key) const {
+        return {this, find_pos(key)};
+    }
+    iterator find(const char* key) {
+        return {this, find_pos(key)};
+    }
+    const_iterator find(const char* key) const {
+        return {this, find_pos(key)};
+    }
+    template<class Key>
+    bool contains(const Key& key) const {
+        return find_pos(key) != slots_.size();
+    }
+    template<class Key>
+    size_t count(const Key& key) const {
+        return contains(key) ? 1 : 0;
+    }
+
+    // Get value by key, throws std::out_of_range for missing keys.
+    template<class Key>
+    T& at(const Key& key) {
+        auto pos = find_pos(key);
+        if(pos == slots_.size())
+            throw std::out_of_range("dict_string_map key not found");
+        return slots_[pos].value->second;
+    }
+    template<class Key>
+    const T& at(const Key& key) const {
+        return const_cast<dict_string_map*>(this)->at(key);
+    }
+
+    T& operator[](const dict_string& key) {
+        return try_emplace(key).first->second;
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(
+        const dict_string& key, Args&&... args) {
+        size_t hash = key.hash();
+        auto pos = probe(hash, identical(key));
+        if(pos != npos)
+            return {iterator{this, pos}, false};
+        if((size_ + 1) * 4 > slots_.size() * 3)
+            rehash(slots_.empty() ? min_capacity : slots_.size() * 2);
+        pos = free_pos(hash);
+        slots_[pos].value.emplace(
+            std::piecewise_construct, std::forward_as_tuple(key),
+            std::forward_as_tuple(std::forward<Args>(args)...));
+        slots_[pos].hash = hash;
+        ++size_;
+        return {iterator{this, pos}, true};
+    }
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return try_emplace(value.first, value.second);
+    }
+
+    // Remove key, returns number of removed elements.
+    template<class Key>
+    size_t erase(const Key& key) {
+        auto pos = find_pos(key);
+        if(pos == slots_.size())
+            return 0;
+        // Backward shift deletion: following elements of the probe
+        // sequence are moved to the released slot.
+        auto mask = slots_.size() - 1;
+        for(auto next = (pos + 1) & mask; slots_[next].value;
+            next = (next + 1) & mask) {
+            auto home = slots_[next].hash & mask;
+            // Element may be moved if its home slot is not in (pos, next].
+            if(((next - home) & mask) >= ((next - pos) & mask)) {
+                slots_[pos].value.emplace(std::move(*slots_[next].value));
+                slots_[pos].hash = slots_[next].hash;
+                pos = next;
+            }
+        }
+        slots_[pos].value.reset();
+        --size_;
+        return 1;
+    }
+
+private:
+    static auto identical(const dict_string& key) {
+        return [&key](const dict_string& v) { return v.identical(key); };
+    }
+
+    // Find slot matching key, returns npos if not found.
+    template<class Match>
+    size_t probe(size_t hash, Match&& match) const {
+        if(slots_.empty())
+            return npos;
+        auto mask = slots_.size() - 1;
+        for(auto pos = hash & mask;; pos = (pos + 1) & mask) {
+            const auto& slot = slots_[pos];
+            if(!slot.value)
+                return npos;
+            if(slot.hash == hash && match(slot.value->first))
+                return pos;
+        }
+    }
+
+    // Key position or slots_.size() (end position) if not found.
+    size_t find_pos(const dict_string& key) const {
+        auto pos = probe(key.hash(), identical(key));
+        return pos != npos ? pos : slots_.size();
+    }
+    size_t find_pos(string_view key) const {
+        auto pos = probe(dict_hash(key), [key](const dict_string& v) {
+            return bits::equal(v.ref(), key);
+        });
+        return pos != npos ? pos : slots_.size();
+    }
+    size_t find_pos(const char* key) const {
+        return find_pos(string_view(key));
+    }
+
+    // First free slot for hash (table should have free slots).
+    size_t free_pos(size_t hash) const {
+        auto mask = slots_.size() - 1;
+        auto pos = hash & mask;
+        while(slots_[pos].value)
+            pos = (pos + 1) & mask;
+        return pos;
+    }
+
+    void rehash(size_t capacity) {
+        slots_t slots(capacity);
+        std::swap(slots_, slots);
+        for(auto& slot : slots) {
+            if(!slot.value)
+                continue;
+            auto pos = free_pos(slot.hash);
+            slots_[pos].value.emplace(std::move(*slot.value));
+            slots_[pos].hash = slot.hash;
+        }
+    }
+
+private:
+    slots_t slots_;
+    size_t size_ = 0;
+};
+
+} // namespace utils
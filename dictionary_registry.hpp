@@ -0,0 +1,128 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Dictionary instance registry and thread local per-instance caches
+// (internal, shared by dictionary implementations).
+//
+// Thread caches are keyed by unique instance ids (never reused), so a
+// destroyed dictionary slot is never matched. Cached values are returned
+// to their dictionaries on slot eviction and thread exit through the
+// registry of live instances.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+namespace utils {
+namespace bits {
+
+// Lock mutex, only try to lock it if wait is false.
+inline bool lock_mutex(std::unique_lock<std::mutex>& lock, bool wait) {
+    if(!wait)
+        return lock.try_lock();
+    lock.lock();
+    return true;
+}
+
+// Dictionary instance id generator (0 is never used).
+inline uint64_t next_instance_id() noexcept {
+    static std::atomic<uint64_t> counter{0};
+    return ++counter;
+}
+
+// Live instances by id (never destroyed, used at thread exit).
+template<class T>
+class instance_registry {
+public:
+    static void add(uint64_t id, T* instance) {
+        std::lock_guard<std::mutex> lock(mutex());
+        instances().emplace(id, instance);
+    }
+
+    // Values cached by threads are not returned after that.
+    static void remove(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex());
+        instances().erase(id);
+    }
+
+    // Call fn(instance) if instance is alive (it is not removed
+    // meanwhile), returns its result, true for removed instance and false
+    // if registry lock is held and wait is false.
+    template<class Fn>
+    static bool visit(uint64_t id, bool wait, Fn fn) {
+        std::unique_lock<std::mutex> lock(mutex(), std::defer_lock);
+        if(!lock_mutex(lock, wait))
+            return false;
+        auto found = instances().find(id);
+        return found == instances().end() || fn(found->second);
+    }
+
+private:
+    static std::mutex& mutex() {
+        static auto* mtx = new std::mutex;
+        return *mtx;
+    }
+    static std::unordered_map<uint64_t, T*>& instances() {
+        static auto* registry = new std::unordered_map<uint64_t, T*>;
+        return *registry;
+    }
+};
+
+// Thread local cache of values for a few instances, new instance replaces
+// the oldest one. Release(id, value, wait) returns value of evicted slot
+// or exited thread, returns false if it would wait and wait is false.
+template<class Value, class Release, size_t SlotCount = 4>
+class thread_instance_cache {
+public:
+    static constexpr size_t slot_count = SlotCount;
+
+    ~thread_instance_cache() {
+        for(auto& slot : slots_) {
+            if(slot.id != 0)
+                Release()(slot.id, slot.value, true);
+        }
+    }
+
+    // Cached value of instance, nullptr if missing.
+    Value* find(uint64_t id) noexcept {
+        for(auto& slot : slots_) {
+            if(slot.id == id)
+                return &slot.value;
+        }
+        return nullptr;
+    }
+
+    // Release the oldest slot value, returns false if release failed.
+    bool evict(bool wait = true) {
+        auto& slot = slots_[next_slot_];
+        if(slot.id != 0 && !Release()(slot.id, slot.value, wait))
+            return false;
+        slot.id = 0;
+        return true;
+    }
+
+    // Take evicted slot for instance (released value is left for reuse).
+    Value& insert(uint64_t id) noexcept {
+        auto& slot = slots_[next_slot_];
+        next_slot_ = (next_slot_ + 1) % slot_count;
+        slot.id = id;
+        return slot.value;
+    }
+
+private:
+    struct slot_t {
+        uint64_t id = 0;
+        Value value{};
+    };
+    std::array<slot_t, slot_count> slots_;
+    size_t next_slot_ = 0;
+};
+
+} // namespace bits
+} // namespace utils
@@ -0,0 +1,585 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "dictionary_snapshot.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DICT_STRING_HAS_MMAP
+#endif
+
+namespace utils {
+namespace {
+
+constexpr char snapshot_magic[8] = {'D', 'I', 'C', 'T', 'S', 'N', 'A', 'P'};
+constexpr uint32_t snapshot_version = 2;
+
+// Hash of known string, detects snapshots built with other hash function.
+constexpr string_view hash_check_str = "dictionary snapshot";
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_header_size;
+    uint64_t hash_check;
+    uint64_t count;
+    uint64_t table_size;
+    uint64_t buckets_offset;
+    uint64_t ids_offset;
+    uint64_t nodes_offset;
+    uint64_t file_size;
+    // literal_dictionary::key_policy of strings.
+    uint64_t key_policy;
+};
+
+[[noreturn]] void snapshot_error(const char* path, const char* what) {
+    throw std::runtime_error(
+        std::string("dictionary snapshot ") + path + ": " + what);
+}
+
+} // namespace
+
+dictionary_snapshot::dictionary_snapshot(const char* path, source src) {
+#ifdef DICT_STRING_HAS_MMAP
+    int fd = src == source::shared_memory ? shm_open(path, O_RDONLY, 0)
+                                          : open(path, O_RDONLY);
+    if(fd < 0)
+        snapshot_error(path, "can't open file");
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        snapshot_error(path, "can't read file");
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED)
+        snapshot_error(path, "can't map file");
+    data_ = static_cast<const char*>(addr);
+#else
+    if(src == source::shared_memory)
+        snapshot_error(path, "shared memory is not supported");
+    std::ifstream is(path, std::ios::binary | std::ios::ate);
+    if(!is)
+        snapshot_error(path, "can't open file");
+    size_ = static_cast<size_t>(is.tellg());
+    buffer_.reset(new char[size_]);
+    is.seekg(0);
+    if(!is.read(buffer_.get(), size_))
+        snapshot_error(path, "can't read file");
+    data_ = buffer_.get();
+#endif
+    try {
+        load(path);
+    }
+    catch(...) {
+#ifdef DICT_STRING_HAS_MMAP
+        munmap(const_cast<char*>(data_), size_);
+#endif
+        throw;
+    }
+}
+
+dictionary_snapshot::dictionary_snapshot(
+    std::unique_ptr<char[]> buffer, size_t size)
+    : data_(buffer.get()), size_(size), buffer_(std::move(buffer)) {
+    load("memory");
+}
+
+dictionary_snapshot::~dictionary_snapshot() {
+#ifdef DICT_STRING_HAS_MMAP
+    if(buffer_ == nullptr)
+        munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+// Check header and setup table pointers.
+void dictionary_snapshot::load(const char* path) {
+    snapshot_header header;
+    if(size_ < sizeof(header))
+        snapshot_error(path, "invalid file");
+    std::memcpy(&header, data_, sizeof(header));
+    if(std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0
+       || header.file_size != size_)
+        snapshot_error(path, "invalid file");
+    if(header.version != snapshot_version
+       || header.node_header_size != node_t::header_size)
+        snapshot_error(path, "unsupported format version");
+    if(header.hash_check != dict_hash(hash_check_str))
+        snapshot_error(path, "built with other hash function");
+    if(header.key_policy != uint64_t(key_policy::exact)
+       && header.key_policy != uint64_t(key_policy::ascii_icase))
+        snapshot_error(path, "invalid file");
+    // Sizes are checked before offsets arithmetic, so nothing overflows.
+    auto table_size = header.table_size;
+    constexpr auto word = sizeof(uint64_t);
+    if(table_size == 0 || (table_size & (table_size - 1)) != 0
+       || table_size >= size_ / word || header.count > size_ / word
+       || header.count > literal_dictionary::max_id
+       || header.buckets_offset < sizeof(header)
+       || header.buckets_offset % word != 0 || header.ids_offset % word != 0
+       || header.buckets_offset > size_ || header.ids_offset > size_
+       || header.buckets_offset + (table_size + 1) * word
+           > header.ids_offset
+       || header.ids_offset + header.count * word > header.nodes_offset
+       || header.nodes_offset > size_)
+        snapshot_error(path, "invalid file");
+    check_nodes(
+        path, reinterpret_cast<const uint64_t*>(data_ + header.buckets_offset),
+        static_cast<size_t>(table_size),
+        reinterpret_cast<const uint64_t*>(data_ + header.ids_offset),
+        static_cast<size_t>(header.count),
+        static_cast<size_t>(header.nodes_offset));
+    buckets_ = reinterpret_cast<const uint64_t*>(data_ + header.buckets_offset);
+    ids_ = reinterpret_cast<const uint64_t*>(data_ + header.ids_offset);
+    table_size_ = static_cast<size_t>(table_size);
+    count_ = static_cast<size_t>(header.count);
+    keys_ = static_cast<key_policy>(header.key_policy);
+}
+
+// Check that buckets and ids refer to nodes within file.
+void dictionary_snapshot::check_nodes(
+    const char* path, const uint64_t* buckets, size_t table_size,
+    const uint64_t* ids, size_t count, size_t nodes_offset) const {
+    constexpr size_t align = std::alignment_of<node_t>::value;
+    // Node (with size prefix, string and terminator) is within range.
+    auto valid_node = [this](const node_t* node, size_t begin, size_t end) {
+        auto offset = static_cast<size_t>(
+            reinterpret_cast<const char*>(node) - data_);
+        if(offset < begin || offset + node_t::header_size > end)
+            return false;
+        auto size = node->size();
+        return offset - begin >= node_t::size_prefix(size)
+            && size <= end - offset - node_t::header_size - 1
+            && node->data()[size] == '\0';
+    };
+    for(size_t i = 0; i < table_size; ++i) {
+        auto pos = buckets[i];
+        auto end = buckets[i + 1];
+        if(pos < nodes_offset || pos > end || end > size_ || pos % align != 0)
+            snapshot_error(path, "invalid file");
+        while(pos < end) {
+            const auto* node = end - pos >= node_t::header_size
+                ? node_t::unlinked(data_ + pos)
+                : nullptr;
+            if(node == nullptr
+               || !valid_node(node, static_cast<size_t>(pos), end)
+               || node->id == 0 || node->id > count)
+                snapshot_error(path, "invalid file");
+            pos += node_size(node->size());
+        }
+    }
+    for(size_t i = 0; i < count; ++i) {
+        auto offset = ids[i];
+        if(offset < nodes_offset || offset > size_ || offset % align != 0)
+            snapshot_error(path, "invalid file");
+        const auto* node = reinterpret_cast<const node_t*>(data_ + offset);
+        if(!valid_node(node, nodes_offset, size_) || node->id != i + 1)
+            snapshot_error(path, "invalid file");
+    }
+}
+
+namespace {
+
+// Snapshot file layout for nodes with ids 1..count.
+struct snapshot_layout {
+    snapshot_header header{};
+    // Node indexes in file order (by bucket).
+    std::vector<uint32_t> order;
+    std::vector<uint64_t> buckets;
+    std::vector<uint64_t> ids;
+};
+
+// Snapshot nodes source: dictionary nodes.
+struct node_array_source {
+    const literal_dictionary_node* const* nodes;
+
+    uint64_t hash(size_t i) const {
+        return nodes[i]->hash();
+    }
+    uint32_t size(size_t i) const {
+        return nodes[i]->size();
+    }
+    uint32_t id(size_t i) const {
+        return nodes[i]->id;
+    }
+    const char* data(size_t i) const {
+        return nodes[i]->data();
+    }
+};
+
+// Snapshot nodes source: unique strings (by index) with ids 1..count.
+struct string_source {
+    const string_view* strs;
+    const uint64_t* hashes;
+    const uint32_t* indexes;
+
+    uint64_t hash(size_t i) const {
+        return hashes[indexes[i]];
+    }
+    uint32_t size(size_t i) const {
+        return static_cast<uint32_t>(strs[indexes[i]].size());
+    }
+    uint32_t id(size_t i) const {
+        return static_cast<uint32_t>(i + 1);
+    }
+    const char* data(size_t i) const {
+        return strs[indexes[i]].data();
+    }
+};
+
+template<class Nodes>
+snapshot_layout make_layout(
+    const Nodes& nodes, size_t count, literal_dictionary::key_policy keys) {
+    // Load factor is kept between 0.5 and 1.
+    size_t table_size = 1;
+    while(table_size < count)
+        table_size <<= 1;
+    auto bucket_num = [&](size_t i) {
+        return static_cast<size_t>(nodes.hash(i) & (table_size - 1));
+    };
+    snapshot_layout layout;
+    layout.order.resize(count);
+    std::iota(layout.order.begin(), layout.order.end(), 0);
+    std::stable_sort(
+        layout.order.begin(), layout.order.end(),
+        [&bucket_num](uint32_t lhs, uint32_t rhs) {
+            return bucket_num(lhs) < bucket_num(rhs);
+        });
+
+    auto& header = layout.header;
+    std::memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+    header.version = snapshot_version;
+    header.node_header_size = literal_dictionary_node::header_size;
+    header.hash_check = dict_hash(hash_check_str);
+    header.key_policy = static_cast<uint64_t>(keys);
+    header.count = count;
+    header.table_size = table_size;
+    header.buckets_offset = sizeof(header);
+    header.ids_offset =
+        header.buckets_offset + (table_size + 1) * sizeof(uint64_t);
+    header.nodes_offset = header.ids_offset + count * sizeof(uint64_t);
+
+    layout.buckets.resize(table_size + 1);
+    layout.ids.resize(count);
+    uint64_t offset = header.nodes_offset;
+    for(size_t bucket = 0, pos = 0; bucket < table_size; ++bucket) {
+        layout.buckets[bucket] = offset;
+        for(; pos < count && bucket_num(layout.order[pos]) == bucket; ++pos) {
+            auto i = layout.order[pos];
+            layout.ids[i] =
+                offset + literal_dictionary_node::size_prefix(nodes.size(i));
+            offset += dictionary_snapshot::node_size(nodes.size(i));
+        }
+    }
+    layout.buckets[table_size] = offset;
+    header.file_size = offset;
+    return layout;
+}
+
+// Write snapshot using output function: out(data, size).
+template<class Nodes, class Output>
+void write_layout(
+    const snapshot_layout& layout, const Nodes& nodes, Output&& out) {
+    using node_t = literal_dictionary_node;
+    out(&layout.header, sizeof(layout.header));
+    out(layout.buckets.data(), layout.buckets.size() * sizeof(uint64_t));
+    out(layout.ids.data(), layout.ids.size() * sizeof(uint64_t));
+    const char padding[std::alignment_of<node_t>::value] = {};
+    for(auto i : layout.order) {
+        // Node header is stored without next link (buckets are ranges).
+        auto size = nodes.size(i);
+        auto prefix = node_t::size_prefix(size);
+        alignas(node_t) char header[node_t::max_size_prefix + sizeof(node_t)];
+        auto* node = new(header + node_t::max_size_prefix) node_t();
+        node->init(nodes.hash(i), size);
+        node->id = nodes.id(i);
+        out(header + node_t::max_size_prefix - prefix,
+            prefix + node_t::header_size);
+        out(nodes.data(i), size);
+        // Padding includes string terminator.
+        out(padding,
+            dictionary_snapshot::node_size(size) - node_t::node_size(size)
+                + 1);
+    }
+}
+
+// Run fn(thread_num) on thread_count threads.
+template<class Fn>
+void run_parallel(size_t thread_count, Fn&& fn) {
+    std::vector<std::thread> threads;
+    for(size_t t = 1; t < thread_count; ++t)
+        threads.emplace_back([&fn, t] { fn(t); });
+    fn(0);
+    for(auto& thread : threads)
+        thread.join();
+}
+
+// Perfect hash pilot search limit per bucket.
+constexpr uint32_t max_pilot = 1 << 20;
+
+} // namespace
+
+// Write snapshot file.
+void dictionary_snapshot::write(
+    const char* path, const literal_dictionary_node* const* nodes,
+    size_t count, key_policy keys) {
+    node_array_source source{nodes};
+    auto layout = make_layout(source, count, keys);
+    // File is written aside and renamed, so mapped snapshot with the same
+    // path stays valid.
+    auto tmp_path = std::string(path) + ".tmp";
+    std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+    if(!os)
+        snapshot_error(path, "can't create file");
+    write_layout(layout, source, [&os](const void* data, size_t size) {
+        os.write(static_cast<const char*>(data), size);
+    });
+    os.close();
+    if(!os) {
+        std::remove(tmp_path.c_str());
+        snapshot_error(path, "can't write file");
+    }
+#ifndef DICT_STRING_HAS_MMAP
+    std::remove(path);
+#endif
+    if(std::rename(tmp_path.c_str(), path) != 0) {
+        std::remove(tmp_path.c_str());
+        snapshot_error(path, "can't replace file");
+    }
+}
+
+// Publish snapshot as POSIX shared memory object.
+void dictionary_snapshot::publish(
+    const char* name, const literal_dictionary_node* const* nodes,
+    size_t count, key_policy keys) {
+#ifdef DICT_STRING_HAS_MMAP
+    node_array_source source{nodes};
+    auto layout = make_layout(source, count, keys);
+    auto size = static_cast<size_t>(layout.header.file_size);
+    // Previous object is unlinked, processes attached to it keep
+    // their mapping.
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd < 0)
+        snapshot_error(name, "can't create shared memory");
+    if(ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        snapshot_error(name, "can't allocate shared memory");
+    }
+    void* addr =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        shm_unlink(name);
+        snapshot_error(name, "can't map shared memory");
+    }
+    auto* pos = static_cast<char*>(addr);
+    write_layout(layout, source, [&pos](const void* data, size_t size) {
+        std::memcpy(pos, data, size);
+        pos += size;
+    });
+    munmap(addr, size);
+#else
+    (void)nodes;
+    (void)count;
+    (void)keys;
+    snapshot_error(name, "shared memory is not supported");
+#endif
+}
+
+// Build snapshot in memory from strings.
+std::unique_ptr<dictionary_snapshot> dictionary_snapshot::build(
+    const string_view* strs, size_t count,
+    const snapshot_build_options& opts) {
+    if(count > UINT32_MAX)
+        throw std::runtime_error("dictionary snapshot: too many strings");
+    auto thread_count = std::max<size_t>(opts.thread_count, 1);
+    // Normalized copies of strings with upper case letters (by thread).
+    std::vector<string_view> keys;
+    std::vector<std::string> key_buffers(thread_count);
+    if(opts.keys == key_policy::ascii_icase) {
+        keys.assign(strs, strs + count);
+        run_parallel(thread_count, [&](size_t t) {
+            auto begin = count * t / thread_count;
+            auto end = count * (t + 1) / thread_count;
+            size_t size = 0;
+            for(auto i = begin; i < end; ++i) {
+                if(bits::has_ascii_upper(strs[i]))
+                    size += strs[i].size();
+            }
+            auto& buffer = key_buffers[t];
+            buffer.resize(size);
+            size_t pos = 0;
+            for(auto i = begin; i < end; ++i) {
+                if(!bits::has_ascii_upper(strs[i]))
+                    continue;
+                bits::ascii_fold(strs[i], &buffer[pos]);
+                keys[i] = string_view(&buffer[pos], strs[i].size());
+                pos += strs[i].size();
+            }
+        });
+        strs = keys.data();
+    }
+    // Hash strings and distribute them to deduplication shards by hash,
+    // each thread keeps its shard lists in strings order.
+    std::vector<uint64_t> hashes(count);
+    std::vector<std::vector<std::vector<uint32_t>>> shards(
+        thread_count, std::vector<std::vector<uint32_t>>(thread_count));
+    run_parallel(thread_count, [&](size_t t) {
+        auto end = count * (t + 1) / thread_count;
+        for(auto i = count * t / thread_count; i < end; ++i) {
+            if(strs[i].empty() || strs[i].size() > UINT32_MAX)
+                continue;
+            hashes[i] = dict_hash(strs[i]);
+            shards[t][hashes[i] % thread_count].push_back(
+                static_cast<uint32_t>(i));
+        }
+    });
+    if(std::any_of(strs, strs + count, [](string_view str) {
+           return str.size() > UINT32_MAX;
+       }))
+        throw std::runtime_error("dictionary snapshot: string too big");
+    // Deduplicate shards keeping first occurrences.
+    std::vector<std::vector<uint32_t>> unique(thread_count);
+    run_parallel(thread_count, [&](size_t shard) {
+        auto hash = [&hashes](uint32_t i) { return hashes[i]; };
+        auto equal = [strs](uint32_t lhs, uint32_t rhs) {
+            return strs[lhs] == strs[rhs];
+        };
+        std::unordered_set<uint32_t, decltype(hash), decltype(equal)> seen(
+            0, hash, equal);
+        for(size_t t = 0; t < thread_count; ++t) {
+            for(auto i : shards[t][shard]) {
+                if(seen.insert(i).second)
+                    unique[shard].push_back(i);
+            }
+        }
+    });
+    std::vector<uint32_t> indexes;
+    for(const auto& shard : unique)
+        indexes.insert(indexes.end(), shard.begin(), shard.end());
+    std::sort(indexes.begin(), indexes.end());
+    if(indexes.size() > literal_dictionary::max_id)
+        throw std::runtime_error("dictionary snapshot: too many strings");
+
+    string_source source{strs, hashes.data(), indexes.data()};
+    auto layout = make_layout(source, indexes.size(), opts.keys);
+    auto size = static_cast<size_t>(layout.header.file_size);
+    std::unique_ptr<char[]> buffer(new char[size]);
+    auto* pos = buffer.get();
+    write_layout(layout, source, [&pos](const void* data, size_t size) {
+        std::memcpy(pos, data, size);
+        pos += size;
+    });
+    std::unique_ptr<dictionary_snapshot> snapshot(
+        new dictionary_snapshot(std::move(buffer), size));
+    if(opts.perfect_hash)
+        snapshot->build_perfect_hash();
+    return snapshot;
+}
+
+// Build perfect hash table (hash and displace): strings are grouped in
+// buckets (4 per bucket on average), pilot of each bucket is searched to
+// move all its strings to free slots, larger buckets go first. Table has
+// 1/64 spare slots, so pilots of the last buckets are found quickly.
+bool dictionary_snapshot::build_perfect_hash() {
+    if(count_ == 0)
+        return false;
+    auto bucket_count = count_ / 4 + 1;
+    auto bucket_num = [bucket_count](uint64_t hash) {
+        return static_cast<size_t>((hash >> 32) % bucket_count);
+    };
+    // Node ids grouped by bucket.
+    std::vector<size_t> bucket_begin(bucket_count + 1, 0);
+    for(size_t id = 1; id <= count_; ++id)
+        ++bucket_begin[bucket_num(node(id)->hash()) + 1];
+    for(size_t i = 0; i < bucket_count; ++i)
+        bucket_begin[i + 1] += bucket_begin[i];
+    std::vector<uint32_t> ids(count_);
+    {
+        auto pos = bucket_begin;
+        for(size_t id = 1; id <= count_; ++id)
+            ids[pos[bucket_num(node(id)->hash())]++] =
+                static_cast<uint32_t>(id);
+    }
+    std::vector<uint32_t> order(bucket_count);
+    std::iota(order.begin(), order.end(), 0);
+    auto bucket_size = [&bucket_begin](size_t bucket) {
+        return bucket_begin[bucket + 1] - bucket_begin[bucket];
+    };
+    std::stable_sort(
+        order.begin(), order.end(), [&bucket_size](uint32_t lhs, uint32_t rhs) {
+            return bucket_size(lhs) > bucket_size(rhs);
+        });
+
+    auto slot_count = count_ + count_ / 64 + 1;
+    std::vector<uint32_t> pilots(bucket_count, 0);
+    std::vector<uint64_t> slots(slot_count, ids_[0]);
+    std::vector<bool> taken(slot_count, false);
+    std::vector<size_t> bucket_slots;
+    for(auto bucket : order) {
+        auto begin = ids.begin() + bucket_begin[bucket];
+        auto end = ids.begin() + bucket_begin[bucket + 1];
+        if(begin == end)
+            break;
+        // Strings with equal hashes can't be separated.
+        std::vector<uint64_t> hashes;
+        for(auto it = begin; it != end; ++it)
+            hashes.push_back(node(*it)->hash());
+        std::sort(hashes.begin(), hashes.end());
+        if(std::adjacent_find(hashes.begin(), hashes.end()) != hashes.end())
+            return false;
+        uint32_t pilot = 0;
+        for(;; ++pilot) {
+            if(pilot == max_pilot)
+                return false;
+            bucket_slots.clear();
+            for(auto it = begin; it != end; ++it) {
+                auto slot = pilot_slot(node(*it)->hash(), pilot, slot_count);
+                if(taken[slot]
+                   || std::find(bucket_slots.begin(), bucket_slots.end(), slot)
+                       != bucket_slots.end())
+                    break;
+                bucket_slots.push_back(slot);
+            }
+            if(bucket_slots.size() == static_cast<size_t>(end - begin))
+                break;
+        }
+        pilots[bucket] = pilot;
+        for(size_t i = 0; i < bucket_slots.size(); ++i) {
+            taken[bucket_slots[i]] = true;
+            slots[bucket_slots[i]] = ids_[begin[i] - 1];
+        }
+    }
+    pilots_ = std::move(pilots);
+    slots_ = std::move(slots);
+    return true;
+}
+
+// Remove published shared memory snapshot.
+void dictionary_snapshot::remove_shared(const char* name) noexcept {
+#ifdef DICT_STRING_HAS_MMAP
+    shm_unlink(name);
+#else
+    (void)name;
+#endif
+}
+
+} // namespace utils
@@ -0,0 +1,176 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Memory-mapped dictionary snapshot.
+//
+// Snapshot file contains dictionary nodes (with the same node header layout
+// as dictionary pages) grouped by buckets of a power of two hashtable.
+// Buckets and ids are stored as offsets from file start, so the file is
+// used directly from read-only mapping without relocation.
+//
+// Snapshot may also be published as POSIX shared memory object, so
+// processes on the same host share one read-only copy of dictionary
+// strings. Dictionary strings are not portable between processes (they
+// are pointers), but string ids are.
+//
+// File layout (native byte order, 8 bytes aligned):
+//   header
+//   bucket offsets [table_size + 1] (bucket nodes end at next bucket offset)
+//   node offsets by id [count]
+//   nodes
+//
+// Snapshot may also be built in memory from a list of strings (frozen
+// dictionary base), optionally with a perfect hash table for single
+// probe lookups (free slots refer to the first node).
+
+#include <memory>
+#include <vector>
+
+#include "shared_string.hpp"
+
+namespace utils {
+
+// In-memory snapshot build options.
+struct snapshot_build_options {
+    // Number of threads for hashing and deduplication.
+    size_t thread_count = 1;
+    // Build perfect hash table (falls back to buckets search if
+    // strings have equal hashes).
+    bool perfect_hash = false;
+    // String key normalization (of dictionary using the snapshot).
+    literal_dictionary::key_policy keys = literal_dictionary::key_policy::exact;
+};
+
+class dictionary_snapshot {
+    using node_t = literal_dictionary_node;
+    using key_policy = literal_dictionary::key_policy;
+
+public:
+    // Snapshot storage.
+    enum class source { file, shared_memory };
+
+    // Map snapshot file (or shared memory object) read-only.
+    // Throws std::runtime_error for missing, incompatible (other format
+    // version, node layout or hash function) or corrupt snapshot files
+    // (all table offsets and node sizes are checked).
+    explicit dictionary_snapshot(
+        const char* path, source src = source::file);
+    ~dictionary_snapshot();
+
+    dictionary_snapshot(const dictionary_snapshot&) = delete;
+    dictionary_snapshot& operator=(const dictionary_snapshot&) = delete;
+
+    // Write snapshot file, node ids should be 1..count in nodes order
+    // (strings normalized by key policy).
+    static void write(
+        const char* path, const literal_dictionary_node* const* nodes,
+        size_t count, key_policy keys = key_policy::exact);
+
+    // Publish snapshot as shared memory object (replacing previous one).
+    static void publish(
+        const char* name, const literal_dictionary_node* const* nodes,
+        size_t count, key_policy keys = key_policy::exact);
+
+    // Remove shared memory object name (attached processes keep mapping).
+    static void remove_shared(const char* name) noexcept;
+
+    // Build snapshot in memory from strings, duplicates are removed
+    // (ids are 1..count in order of first occurrence, empty strings are
+    // skipped). Strings are normalized by options key policy.
+    static std::unique_ptr<dictionary_snapshot> build(
+        const string_view* strs, size_t count,
+        const snapshot_build_options& opts = snapshot_build_options());
+
+    // Stored node size with size prefix and padding.
+    static constexpr size_t node_size(size_t str_size) noexcept {
+        constexpr size_t align = std::alignment_of<node_t>::value;
+        return (node_t::node_size(str_size) + align - 1) & ~(align - 1);
+    }
+
+    // Number of snapshot strings (ids are 1..count).
+    size_t count() const noexcept {
+        return count_;
+    }
+
+    // Key policy snapshot strings are normalized by.
+    key_policy keys() const noexcept {
+        return keys_;
+    }
+
+    // Get node by id (1..count).
+    const literal_dictionary_node* node(size_t id) const noexcept {
+        return reinterpret_cast<const node_t*>(data_ + ids_[id - 1]);
+    }
+
+    // Perfect hash table is used for lookups.
+    bool has_perfect_hash() const noexcept {
+        return !pilots_.empty();
+    }
+
+    // Find node in snapshot hashtable.
+    const literal_dictionary_node* find(
+        uint64_t hash, string_view str) const noexcept {
+        if(!pilots_.empty()) {
+            const auto* node = reinterpret_cast<const node_t*>(
+                data_ + slots_[perfect_slot(hash)]);
+            return node->hash() == hash && node->equals(str) ? node : nullptr;
+        }
+        auto bucket_num = static_cast<size_t>(hash & (table_size_ - 1));
+        const char* pos = data_ + buckets_[bucket_num];
+        const char* end = data_ + buckets_[bucket_num + 1];
+        while(pos < end) {
+            const auto* node = node_t::unlinked(pos);
+            if(node->hash() == hash && node->equals(str))
+                return node;
+            pos += node_size(node->size());
+        }
+        return nullptr;
+    }
+
+private:
+    // Snapshot in memory buffer.
+    dictionary_snapshot(std::unique_ptr<char[]> buffer, size_t size);
+
+    // Check header and setup table pointers.
+    void load(const char* path);
+
+    // Check that buckets and ids refer to nodes within file.
+    void check_nodes(
+        const char* path, const uint64_t* buckets, size_t table_size,
+        const uint64_t* ids, size_t count, size_t nodes_offset) const;
+
+    // Perfect hash slot of hash: pilot of hash bucket displaces the slot.
+    static size_t pilot_slot(
+        uint64_t hash, uint64_t pilot, size_t slot_count) noexcept {
+        return static_cast<size_t>(
+            bits::mix64(hash ^ (pilot * 0x9E3779B97F4A7C15ull), pilot_seed)
+            % slot_count);
+    }
+    size_t perfect_slot(uint64_t hash) const noexcept {
+        return pilot_slot(
+            hash, pilots_[(hash >> 32) % pilots_.size()], slots_.size());
+    }
+
+    // Build perfect hash table, returns false on failure.
+    bool build_perfect_hash();
+
+    static constexpr uint64_t pilot_seed = 0xD6E8FEB86659FD93ull;
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // Heap copy if file mapping is not supported.
+    std::unique_ptr<char[]> buffer_;
+    const uint64_t* buckets_ = nullptr;
+    const uint64_t* ids_ = nullptr;
+    size_t table_size_ = 0;
+    size_t count_ = 0;
+    key_policy keys_ = key_policy::exact;
+    // Perfect hash: pilots by hash bucket, node offsets by slot.
+    std::vector<uint32_t> pilots_;
+    std::vector<uint64_t> slots_;
+};
+
+} // namespace utils
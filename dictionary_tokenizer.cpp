@@ -0,0 +1,142 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "dictionary_tokenizer.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace utils {
+
+namespace {
+
+constexpr size_t block_size = 64;
+
+#if defined(__AVX2__)
+// Delimiter bits of 64 bytes (two 32 bytes compares per delimiter).
+uint64_t simd_delimiter_mask(
+    const char* data, const char* delimiters, size_t count) noexcept {
+    auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+    auto lo_eq = _mm256_setzero_si256();
+    auto hi_eq = _mm256_setzero_si256();
+    for(size_t i = 0; i < count; ++i) {
+        auto delimiter = _mm256_set1_epi8(delimiters[i]);
+        lo_eq = _mm256_or_si256(lo_eq, _mm256_cmpeq_epi8(lo, delimiter));
+        hi_eq = _mm256_or_si256(hi_eq, _mm256_cmpeq_epi8(hi, delimiter));
+    }
+    return static_cast<uint32_t>(_mm256_movemask_epi8(lo_eq))
+        | uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(hi_eq))) << 32;
+}
+#elif defined(DICT_STRING_SSE2)
+uint64_t simd_delimiter_mask(
+    const char* data, const char* delimiters, size_t count) noexcept {
+    uint64_t mask = 0;
+    for(size_t j = 0; j < block_size / 16; ++j) {
+        auto chunk =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + j * 16));
+        auto eq = _mm_setzero_si128();
+        for(size_t i = 0; i < count; ++i)
+            eq = _mm_or_si128(
+                eq, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(delimiters[i])));
+        mask |= uint64_t(static_cast<unsigned>(_mm_movemask_epi8(eq)))
+            << (j * 16);
+    }
+    return mask;
+}
+#elif defined(DICT_STRING_NEON)
+uint64_t simd_delimiter_mask(
+    const char* data, const char* delimiters, size_t count) noexcept {
+    // Bit of each byte position, summed per 8 bytes half (movemask).
+    constexpr uint8_t weights[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    auto bit = vld1q_u8(weights);
+    uint64_t mask = 0;
+    for(size_t j = 0; j < block_size / 16; ++j) {
+        auto chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + j * 16));
+        auto eq = vdupq_n_u8(0);
+        for(size_t i = 0; i < count; ++i)
+            eq = vorrq_u8(
+                eq,
+                vceqq_u8(
+                    chunk, vdupq_n_u8(static_cast<uint8_t>(delimiters[i]))));
+        auto bits = vandq_u8(eq, bit);
+        mask |= uint64_t(vaddv_u8(vget_low_u8(bits))) << (j * 16);
+        mask |= uint64_t(vaddv_u8(vget_high_u8(bits))) << (j * 16 + 8);
+    }
+    return mask;
+}
+#endif
+
+} // namespace
+
+dictionary_tokenizer::dictionary_tokenizer(
+    literal_dictionary& dict, string_view delimiters)
+    : dict_(dict) {
+    for(auto c : delimiters) {
+        if(is_delimiter(c))
+            continue;
+        auto byte = static_cast<unsigned char>(c);
+        delimiter_set_[byte >> 6] |= uint64_t(1) << (byte & 63);
+        if(simd_delimiter_count_ < simd_delimiters_.size())
+            simd_delimiters_[simd_delimiter_count_] = c;
+        ++simd_delimiter_count_;
+    }
+    // Large delimiter sets are classified by table lookup.
+    if(simd_delimiter_count_ > simd_delimiters_.size())
+        simd_delimiter_count_ = 0;
+}
+
+// Add tokens of input to dictionary, appending them to result.
+void dictionary_tokenizer::tokenize(
+    string_view input, std::vector<string>& result) {
+    for_each_batch(input, [&](const string_view* tokens, size_t count) {
+        auto offset = result.size();
+        result.resize(offset + count);
+        dict_.add_many(tokens, count, result.data() + offset);
+    });
+}
+
+// Add tokens of input to dictionary, appending their dense ids.
+void dictionary_tokenizer::tokenize_ids(
+    string_view input, std::vector<uint32_t>& result) {
+    std::array<string, literal_dictionary::max_batch_size> strs;
+    for_each_batch(input, [&](const string_view* tokens, size_t count) {
+        dict_.add_many(tokens, count, strs.data());
+        for(size_t i = 0; i < count; ++i)
+            result.push_back(dict_.id(strs[i]));
+    });
+}
+
+// Delimiter bits of 64 bytes block (bytes beyond size are delimiters).
+uint64_t dictionary_tokenizer::delimiter_mask(
+    const char* data, size_t size) const noexcept {
+    // Partial block is copied, so nothing is read beyond input end.
+    std::array<char, block_size> tail;
+    if(size < block_size) {
+        tail.fill(0);
+        std::memcpy(tail.data(), data, size);
+        data = tail.data();
+    }
+    uint64_t mask = 0;
+#if defined(__AVX2__) || defined(DICT_STRING_SSE2) \
+    || defined(DICT_STRING_NEON)
+    if(simd_delimiter_count_ != 0) {
+        mask = simd_delimiter_mask(
+            data, simd_delimiters_.data(), simd_delimiter_count_);
+    }
+    else
+#endif
+    {
+        for(size_t i = 0; i < size; ++i)
+            mask |= uint64_t(is_delimiter(data[i])) << i;
+    }
+    if(size < block_size)
+        mask |= ~uint64_t(0) << size;
+    return mask;
+}
+
+} // namespace utils
@@ -0,0 +1,118 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Zero-copy tokenizing interner.
+//
+// Input buffer (string or mapped file contents) is split by delimiter
+// bytes classified 64 bytes at a time (SIMD compare with AVX2, SSE2 or
+// NEON for small delimiter sets), tokens are referenced in place and
+// added to dictionary in batches (add_many), so no string is allocated
+// per token.
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "shared_string.hpp"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace utils {
+
+class dictionary_tokenizer {
+public:
+    using string = literal_dictionary::string;
+
+    // Whitespace delimiters.
+    static constexpr const char* default_delimiters = " \t\r\n";
+
+    // Delimiter sets up to this size are compared with SIMD,
+    // larger ones are classified by table lookup.
+    static constexpr size_t max_simd_delimiters = 8;
+
+    explicit dictionary_tokenizer(
+        literal_dictionary& dict = literal_dictionary::global(),
+        string_view delimiters = default_delimiters);
+
+    // Add tokens of input to dictionary, appending them to result.
+    void tokenize(string_view input, std::vector<string>& result);
+
+    // Add tokens of input to dictionary, appending their dense ids.
+    void tokenize_ids(string_view input, std::vector<uint32_t>& result);
+
+    // Call fn(const string_view* tokens, size_t count) for token batches
+    // (up to literal_dictionary::max_batch_size tokens).
+    template<class Fn>
+    void for_each_batch(string_view input, Fn&& fn) const;
+
+private:
+    // Delimiter bits of 64 bytes block (bytes beyond size are delimiters).
+    uint64_t delimiter_mask(const char* data, size_t size) const noexcept;
+
+    // Index of the lowest bit set.
+    static unsigned first_bit(uint64_t x) noexcept {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, x);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+    }
+
+    bool is_delimiter(char c) const noexcept {
+        auto byte = static_cast<unsigned char>(c);
+        return ((delimiter_set_[byte >> 6] >> (byte & 63)) & 1) != 0;
+    }
+
+private:
+    literal_dictionary& dict_;
+    // Delimiter bytes bitmap.
+    std::array<uint64_t, 4> delimiter_set_{};
+    // Delimiter bytes compared with SIMD (none if set is too large).
+    std::array<char, max_simd_delimiters> simd_delimiters_{};
+    size_t simd_delimiter_count_ = 0;
+};
+
+template<class Fn>
+void dictionary_tokenizer::for_each_batch(string_view input, Fn&& fn) const {
+    constexpr size_t block_size = 64;
+    std::array<string_view, literal_dictionary::max_batch_size> batch;
+    size_t count = 0;
+    // Start of token continuing from previous block, if any.
+    size_t token_begin = 0;
+    bool in_token = false;
+    for(size_t block = 0; block < input.size(); block += block_size) {
+        auto size = std::min(block_size, input.size() - block);
+        auto tokens = ~delimiter_mask(input.data() + block, size);
+        // Token bytes preceded by delimiter (or block start outside token)
+        // start tokens, delimiters preceded by token bytes end them.
+        auto prev = tokens << 1 | (in_token ? 1 : 0);
+        auto bounds = tokens ^ prev;
+        while(bounds != 0) {
+            auto pos = block + first_bit(bounds);
+            bounds &= bounds - 1;
+            if(!in_token) {
+                token_begin = pos;
+                in_token = true;
+                continue;
+            }
+            in_token = false;
+            batch[count++] = input.substr(token_begin, pos - token_begin);
+            if(count == batch.size()) {
+                fn(batch.data(), count);
+                count = 0;
+            }
+        }
+    }
+    if(in_token)
+        batch[count++] = input.substr(token_begin);
+    if(count != 0)
+        fn(batch.data(), count);
+}
+
+} // namespace utils
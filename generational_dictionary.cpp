@@ -0,0 +1,298 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "generational_dictionary.hpp"
+
+#include <algorithm>
+
+#include "dictionary_registry.hpp"
+
+namespace utils {
+
+// Dictionary generation.
+struct generational_dictionary::generation_t {
+    generation_t(
+        uint64_t number, const literal_dictionary::options& opts,
+        pmr::memory_resource* mem)
+        : dict(opts, mem), number(number) {
+    }
+    literal_dictionary dict;
+    const uint64_t number;
+    // Next older generation.
+    std::atomic<generation_t*> older{nullptr};
+    // Retirement epoch and retired generations link.
+    uint64_t retire_epoch = 0;
+    generation_t* next_retired = nullptr;
+};
+
+// Reader record, padded to separate cache lines.
+struct alignas(64) generational_dictionary::reader_t {
+    // Entered epoch, 0 if reader is not active.
+    std::atomic<uint64_t> epoch{0};
+    // Guards nesting depth (owner thread only).
+    size_t depth = 0;
+    // Record is cached by a thread (released records are reused).
+    std::atomic<bool> owned{true};
+    reader_t* next = nullptr;
+};
+
+namespace {
+
+// Live dictionaries, reader records of thread cache slots are released
+// only for live ones.
+using dictionary_registry =
+    bits::instance_registry<const generational_dictionary>;
+
+// Generations don't map base snapshot.
+literal_dictionary::options generation_options(
+    literal_dictionary::options opts) {
+    opts.snapshot_path = nullptr;
+    opts.shared_snapshot_name = nullptr;
+    return opts;
+}
+
+} // namespace
+
+// Release cached reader record (if its dictionary is still alive).
+struct generational_dictionary::thread_reader_release {
+    bool operator()(uint64_t dict_id, reader_t* reader, bool wait) const {
+        return dictionary_registry::visit(
+            dict_id, wait, [reader](const generational_dictionary*) {
+                release_reader(reader);
+                return true;
+            });
+    }
+};
+
+// Thread local reader cache for a few dictionaries.
+struct generational_dictionary::thread_reader_cache
+    : bits::thread_instance_cache<reader_t*, thread_reader_release> {};
+
+thread_local generational_dictionary::thread_reader_cache
+    generational_dictionary::thread_readers_;
+
+generational_dictionary::guard::guard(const generational_dictionary& dict)
+    : reader_(dict.thread_reader()) {
+    if(reader_->depth++ == 0)
+        reader_->epoch.store(dict.epoch_.load());
+}
+
+generational_dictionary::guard::~guard() {
+    if(--reader_->depth == 0)
+        reader_->epoch.store(0);
+}
+
+generational_dictionary::generational_dictionary()
+    : generational_dictionary(literal_dictionary::options{}) {
+}
+
+generational_dictionary::generational_dictionary(
+    const literal_dictionary::options& opts, pmr::memory_resource* mem)
+    : base_{opts, mem}
+    , instance_id_{bits::next_instance_id()}
+    , opts_{generation_options(opts)}
+    , mem_{mem} {
+    current_.store(create_generation(1));
+    generation_count_ = 1;
+    dictionary_registry::add(instance_id_, this);
+}
+
+generational_dictionary::~generational_dictionary() {
+    // Reader records cached by threads are not released after that.
+    dictionary_registry::remove(instance_id_);
+    auto* generation = current_.load();
+    while(generation != nullptr) {
+        auto* older = generation->older.load();
+        destroy_generation(generation);
+        generation = older;
+    }
+    while(retired_ != nullptr) {
+        auto* next = retired_->next_retired;
+        destroy_generation(retired_);
+        retired_ = next;
+    }
+    while(readers_ != nullptr) {
+        auto* next = readers_->next;
+        readers_->~reader_t();
+        mem_->deallocate(
+            readers_, sizeof(reader_t), std::alignment_of<reader_t>::value);
+        readers_ = next;
+    }
+}
+
+// Find string in base or live generations, otherwise add it.
+generational_dictionary::string generational_dictionary::add(
+    string_view str) {
+    guard lock(*this);
+    if(auto found = find(str))
+        return *found;
+    return current_.load()->dict.add(str);
+}
+
+// Find string in base or live generations (never adds).
+std::optional<generational_dictionary::string> generational_dictionary::find(
+    string_view str) const {
+    guard lock(*this);
+    if(auto found = base_.find(str))
+        return found;
+    for(auto* generation = current_.load(); generation != nullptr;
+        generation = generation->older.load()) {
+        if(auto found = generation->dict.find(str))
+            return found;
+    }
+    return std::nullopt;
+}
+
+// Add permanent string to base dictionary.
+generational_dictionary::string generational_dictionary::pin(
+    string_view str) {
+    return base_.add(str);
+}
+
+// Start new current generation.
+uint64_t generational_dictionary::advance() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto* current = current_.load();
+    auto* generation = create_generation(current->number + 1);
+    generation->older.store(current);
+    current_.store(generation);
+    ++generation_count_;
+    return generation->number;
+}
+
+// Retire the oldest generation.
+bool generational_dictionary::retire_oldest() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(generation_count_ < 2)
+            return false;
+        auto* newer = current_.load();
+        auto* oldest = newer->older.load();
+        while(oldest->older.load() != nullptr) {
+            newer = oldest;
+            oldest = oldest->older.load();
+        }
+        // Readers entering since the next epoch can't see the generation.
+        newer->older.store(nullptr);
+        oldest->retire_epoch = epoch_.fetch_add(1) + 1;
+        oldest->next_retired = retired_;
+        retired_ = oldest;
+        --generation_count_;
+    }
+    collect();
+    return true;
+}
+
+// Release retired generations no more visible to readers.
+size_t generational_dictionary::collect() {
+    generation_t* released = nullptr;
+    size_t released_count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto min_epoch = ~uint64_t(0);
+        for(auto* reader = readers_; reader != nullptr; reader = reader->next) {
+            auto epoch = reader->epoch.load();
+            if(epoch != 0)
+                min_epoch = std::min(min_epoch, epoch);
+        }
+        auto** link = &retired_;
+        while(*link != nullptr) {
+            auto* generation = *link;
+            if(generation->retire_epoch <= min_epoch) {
+                *link = generation->next_retired;
+                generation->next_retired = released;
+                released = generation;
+                ++released_count;
+            }
+            else
+                link = &generation->next_retired;
+        }
+    }
+    // Memory is released outside of the lock.
+    while(released != nullptr) {
+        auto* next = released->next_retired;
+        destroy_generation(released);
+        released = next;
+    }
+    return released_count;
+}
+
+// Number of live generations.
+size_t generational_dictionary::generation_count() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return generation_count_;
+}
+
+// Number of reader records.
+size_t generational_dictionary::reader_count() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t count = 0;
+    for(auto* reader = readers_; reader != nullptr; reader = reader->next)
+        ++count;
+    return count;
+}
+
+// Get reader record of current thread.
+generational_dictionary::reader_t*
+generational_dictionary::thread_reader() const {
+    auto& cache = thread_readers_;
+    if(auto* reader = cache.find(instance_id_))
+        return *reader;
+    // Take released reader or create new one, replacing the oldest cached
+    // one (released reader stays active until its guards are released).
+    cache.evict();
+    reader_t* reader = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto* free = readers_; free != nullptr; free = free->next) {
+            // Inactive epoch is stored after the last guard release.
+            if(!free->owned.load() && free->epoch.load() == 0) {
+                free->owned.store(true);
+                reader = free;
+                break;
+            }
+        }
+        if(reader == nullptr) {
+            reader = new(mem_->allocate(
+                sizeof(reader_t), std::alignment_of<reader_t>::value))
+                reader_t();
+            reader->next = readers_;
+            readers_ = reader;
+        }
+    }
+    cache.insert(instance_id_) = reader;
+    return reader;
+}
+
+// Release reader record of evicted thread cache slot or exited thread.
+void generational_dictionary::release_reader(reader_t* reader) {
+    reader->owned.store(false);
+}
+
+// Create generation.
+generational_dictionary::generation_t*
+generational_dictionary::create_generation(uint64_t number) {
+    auto* memory = mem_->allocate(
+        sizeof(generation_t), std::alignment_of<generation_t>::value);
+    try {
+        return new(memory) generation_t(number, opts_, mem_);
+    }
+    catch(...) {
+        mem_->deallocate(
+            memory, sizeof(generation_t),
+            std::alignment_of<generation_t>::value);
+        throw;
+    }
+}
+
+// Destroy generation releasing its memory.
+void generational_dictionary::destroy_generation(generation_t* generation) {
+    generation->~generation_t();
+    mem_->deallocate(
+        generation, sizeof(generation_t),
+        std::alignment_of<generation_t>::value);
+}
+
+} // namespace utils
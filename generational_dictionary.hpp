@@ -0,0 +1,125 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Generational string dictionary.
+//
+// Strings are added to the current generation (independent dictionary
+// instance), permanent strings are pinned in the base dictionary.
+// Generations are retired oldest first and their memory is returned to
+// memory resource once no reader may access them.
+//
+// Reclamation is epoch based: readers enter global epoch with a guard,
+// retired generation is released when all active readers have entered
+// epochs following its retirement. Strings of non-pinned generations
+// should not be used after the guard they were obtained under is released.
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+
+#include "shared_string.hpp"
+
+namespace utils {
+
+class generational_dictionary {
+    struct generation_t;
+    struct reader_t;
+    struct thread_reader_release;
+    struct thread_reader_cache;
+
+public:
+    using string = literal_dictionary::string;
+
+    // Reader epoch guard, protects generations from release.
+    // Guards may be nested.
+    class guard {
+    public:
+        explicit guard(const generational_dictionary& dict);
+        ~guard();
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+    private:
+        reader_t* reader_;
+    };
+
+    // Dictionary with generations and base allocated from memory resource.
+    generational_dictionary();
+    explicit generational_dictionary(
+        const literal_dictionary::options& opts,
+        pmr::memory_resource* mem = pmr::get_default_resource());
+    ~generational_dictionary();
+
+    generational_dictionary(const generational_dictionary&) = delete;
+    generational_dictionary& operator=(const generational_dictionary&) =
+        delete;
+
+    // Find string in base or live generations, otherwise add it to the
+    // current generation. Call under guard to keep result valid.
+    string add(string_view str);
+
+    // Find string in base or live generations (never adds).
+    std::optional<string> find(string_view str) const;
+
+    // Add permanent string to base dictionary (never released).
+    string pin(string_view str);
+
+    literal_dictionary& base() noexcept {
+        return base_;
+    }
+
+    // Start new current generation, returns its number.
+    uint64_t advance();
+
+    // Retire the oldest generation (current generation is never retired),
+    // returns false if there is nothing to retire.
+    bool retire_oldest();
+
+    // Release retired generations no more visible to readers,
+    // returns number of released generations.
+    size_t collect();
+
+    // Number of live (not retired) generations.
+    size_t generation_count() const;
+
+    // Number of reader records (records released by threads are reused).
+    size_t reader_count() const;
+
+private:
+    // Get reader record of current thread.
+    reader_t* thread_reader() const;
+
+    // Release reader record of evicted thread cache slot or exited thread
+    // (reused once its guards are released).
+    static void release_reader(reader_t* reader);
+
+    static thread_local thread_reader_cache thread_readers_;
+
+    // Create generation.
+    generation_t* create_generation(uint64_t number);
+
+    // Destroy generation releasing its memory.
+    void destroy_generation(generation_t* generation);
+
+private:
+    literal_dictionary base_;
+    // Newest (current) generation, generations are linked to older ones.
+    std::atomic<generation_t*> current_{nullptr};
+    // Global epoch (starts from 1, 0 means inactive reader).
+    std::atomic<uint64_t> epoch_{1};
+    // Unique dictionary instance id (thread reader cache key).
+    const uint64_t instance_id_;
+    const literal_dictionary::options opts_;
+    pmr::memory_resource* mem_;
+    // Generations and readers management (guarded by mtx_).
+    mutable std::mutex mtx_;
+    size_t generation_count_ = 0;
+    generation_t* retired_ = nullptr;
+    mutable reader_t* readers_ = nullptr;
+};
+
+} // namespace utils
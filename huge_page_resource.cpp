@@ -0,0 +1,197 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+#include "huge_page_resource.hpp"
+
+#include <new>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define DICT_STRING_HAS_MMAP
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace utils {
+namespace {
+
+size_t round_up(size_t size, size_t align) {
+    return (size + align - 1) / align * align;
+}
+
+#if defined(__linux__)
+// Apply NUMA memory policy (see mbind(2), without libnuma dependency).
+void apply_numa_policy(
+    void* addr, size_t size, huge_page_memory_resource::numa_policy policy,
+    unsigned long nodes) {
+    using numa_policy = huge_page_memory_resource::numa_policy;
+    constexpr int mpol_preferred = 1;
+    constexpr int mpol_bind = 2;
+    constexpr int mpol_interleave = 3;
+    int mode = 0;
+    switch(policy) {
+    case numa_policy::none:
+        return;
+    case numa_policy::preferred:
+        mode = mpol_preferred;
+        break;
+    case numa_policy::bind:
+        mode = mpol_bind;
+        break;
+    case numa_policy::interleave:
+        mode = mpol_interleave;
+        break;
+    }
+    // Policy is an optimization, failure (no NUMA support) is ignored.
+    syscall(
+        SYS_mbind, addr, size, mode, &nodes, sizeof(nodes) * 8 + 1, 0);
+}
+#endif
+
+} // namespace
+
+huge_page_memory_resource::huge_page_memory_resource()
+    : huge_page_memory_resource(options{}) {
+}
+
+huge_page_memory_resource::huge_page_memory_resource(
+    const options& opts, pmr::memory_resource* upstream)
+    : opts_{opts}, upstream_{upstream} {
+}
+
+huge_page_memory_resource::~huge_page_memory_resource() {
+    for(auto& region : regions_)
+        unmap(region.addr, region.size);
+}
+
+size_t huge_page_memory_resource::mapped_size() const {
+    return mapped_size_.load();
+}
+
+bool huge_page_memory_resource::supported() noexcept {
+#ifdef DICT_STRING_HAS_MMAP
+    return true;
+#else
+    return false;
+#endif
+}
+
+void* huge_page_memory_resource::do_allocate(size_t bytes, size_t alignment) {
+    if(!supported())
+        return upstream_->allocate(bytes, alignment);
+    auto region_size = round_up(opts_.region_size, opts_.page_size);
+    // Large allocations are mapped separately.
+    if(bytes > region_size / 2)
+        return map(round_up(bytes, opts_.page_size));
+    auto cls = size_class(bytes);
+    bytes = size_t(1) << cls;
+    std::lock_guard<std::mutex> lock(mtx_);
+    // Freed blocks are aligned by their first allocations.
+    if(auto* block = free_lists_[cls]) {
+        if(reinterpret_cast<uintptr_t>(block) % alignment == 0) {
+            free_lists_[cls] = block->next;
+            return block;
+        }
+    }
+    auto padding = round_up(reinterpret_cast<uintptr_t>(current_), alignment)
+        - reinterpret_cast<uintptr_t>(current_);
+    if(current_ == nullptr || remain_ < bytes + padding) {
+        current_ = static_cast<char*>(map(region_size));
+        remain_ = region_size;
+        regions_.push_back({current_, region_size});
+        padding = 0;
+    }
+    auto* result = current_ + padding;
+    current_ += padding + bytes;
+    remain_ -= padding + bytes;
+    return result;
+}
+
+void huge_page_memory_resource::do_deallocate(
+    void* p, size_t bytes, size_t alignment) {
+    if(!supported())
+        return upstream_->deallocate(p, bytes, alignment);
+    auto region_size = round_up(opts_.region_size, opts_.page_size);
+    if(bytes > region_size / 2)
+        return unmap(p, round_up(bytes, opts_.page_size));
+    // Small allocations are reused, regions are released on destruction.
+    auto cls = size_class(bytes);
+    auto* block = static_cast<free_block*>(p);
+    std::lock_guard<std::mutex> lock(mtx_);
+    block->next = free_lists_[cls];
+    free_lists_[cls] = block;
+}
+
+// Small allocations size class (log2 of allocated size).
+size_t huge_page_memory_resource::size_class(size_t bytes) noexcept {
+    size_t cls = 4;
+    while((size_t(1) << cls) < bytes)
+        ++cls;
+    return cls;
+}
+
+bool huge_page_memory_resource::do_is_equal(
+    const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+// Map new memory applying huge page and NUMA options.
+void* huge_page_memory_resource::map(size_t size) {
+#ifdef DICT_STRING_HAS_MMAP
+    void* addr = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    if(opts_.use_hugetlb) {
+        int page_shift = 0;
+        while((size_t(1) << page_shift) < opts_.page_size)
+            ++page_shift;
+        addr = mmap(
+            nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << 26), -1,
+            0);
+    }
+#endif
+    if(addr == MAP_FAILED) {
+        // Reserve extra page to align mapping for transparent huge pages.
+        auto map_size = size + opts_.page_size;
+        auto* base = mmap(
+            nullptr, map_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED)
+            throw std::bad_alloc();
+        auto begin = reinterpret_cast<uintptr_t>(base);
+        auto aligned = round_up(begin, opts_.page_size);
+        if(aligned != begin)
+            munmap(base, aligned - begin);
+        auto tail = begin + map_size - (aligned + size);
+        if(tail != 0)
+            munmap(reinterpret_cast<void*>(aligned + size), tail);
+        addr = reinterpret_cast<void*>(aligned);
+#if defined(MADV_HUGEPAGE)
+        madvise(addr, size, MADV_HUGEPAGE);
+#endif
+    }
+#if defined(__linux__)
+    apply_numa_policy(addr, size, opts_.numa, opts_.numa_nodes);
+#endif
+    mapped_size_ += size;
+    return addr;
+#else
+    (void)size;
+    throw std::bad_alloc();
+#endif
+}
+
+void huge_page_memory_resource::unmap(void* p, size_t size) {
+#ifdef DICT_STRING_HAS_MMAP
+    munmap(p, size);
+    mapped_size_ -= size;
+#else
+    (void)p;
+    (void)size;
+#endif
+}
+
+} // namespace utils
@@ -0,0 +1,98 @@
+#pragma once
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Huge page backed memory resource.
+//
+// Memory is mapped by regions aligned to huge page size, small allocations
+// (dictionary pages) are carved from regions by power of two size classes,
+// freed ones are reused by the same class allocations (regions are
+// unmapped on resource destruction only), large allocations (table
+// segments) get own mappings.
+// Regions may be interleaved or bound to NUMA nodes.
+// On platforms without mmap upstream resource is used instead.
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "shared_string.hpp"
+
+namespace utils {
+
+class huge_page_memory_resource : public pmr::memory_resource {
+public:
+    // Region NUMA memory policy.
+    enum class numa_policy { none, preferred, bind, interleave };
+
+    static constexpr size_t page_size_2m = size_t(2) * 1024 * 1024;
+    static constexpr size_t page_size_1g = size_t(1024) * 1024 * 1024;
+
+    struct options {
+        // Huge page size (2MB or 1GB).
+        size_t page_size = page_size_2m;
+        // Mapping size for small allocations (rounded to page size).
+        size_t region_size = 16 * page_size_2m;
+        // Use explicit huge pages (MAP_HUGETLB) which should be reserved
+        // by system, otherwise transparent huge pages are requested.
+        // Falls back to transparent huge pages if mapping fails.
+        bool use_hugetlb = false;
+        // NUMA policy and node mask (bit per node).
+        numa_policy numa = numa_policy::none;
+        unsigned long numa_nodes = 0;
+    };
+
+    huge_page_memory_resource();
+    explicit huge_page_memory_resource(
+        const options& opts,
+        pmr::memory_resource* upstream = pmr::get_default_resource());
+    ~huge_page_memory_resource() override;
+
+    huge_page_memory_resource(const huge_page_memory_resource&) = delete;
+    huge_page_memory_resource& operator=(const huge_page_memory_resource&) =
+        delete;
+
+    // Total mapped memory size.
+    size_t mapped_size() const;
+
+    // Huge page mappings supported on this platform.
+    static bool supported() noexcept;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const pmr::memory_resource& other) const
+        noexcept override;
+
+    // Freed small allocation.
+    struct free_block {
+        free_block* next;
+    };
+
+    // Small allocations size class (log2 of allocated size).
+    static size_t size_class(size_t bytes) noexcept;
+
+    // Map new memory applying huge page and NUMA options.
+    void* map(size_t size);
+    void unmap(void* p, size_t size);
+
+    struct mapping {
+        void* addr;
+        size_t size;
+    };
+
+    const options opts_;
+    pmr::memory_resource* upstream_;
+    // Small allocations regions (guarded by mtx_).
+    std::mutex mtx_;
+    std::vector<mapping> regions_;
+    char* current_ = nullptr;
+    size_t remain_ = 0;
+    std::array<free_block*, 64> free_lists_{};
+    std::atomic<size_t> mapped_size_{0};
+};
+
+} // namespace utils
@@ -5,41 +5,346 @@
 //
 #include "shared_string.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "dictionary_registry.hpp"
+#include "dictionary_snapshot.hpp"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace utils {
 namespace bits {
 
-inline uint32_t reverse_bit_order(uint32_t x) {
-    x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
-    x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
-    x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
-    x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
-    return (x >> 16) | (x << 16);
+inline uint64_t reverse_bit_order(uint64_t x) {
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_bitreverse64)
+    return __builtin_bitreverse64(x);
+#define DICT_STRING_HAS_BITREVERSE
+#endif
+#endif
+#ifndef DICT_STRING_HAS_BITREVERSE
+#if defined(__aarch64__)
+    uint64_t r;
+    asm("rbit %0, %1" : "=r"(r) : "r"(x));
+    return r;
+#else
+    // Reverse bits inside bytes and swap bytes.
+    x = ((x >> 1) & 0x5555555555555555) | ((x & 0x5555555555555555) << 1);
+    x = ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0F) | ((x & 0x0F0F0F0F0F0F0F0F) << 4);
+#if defined(_MSC_VER)
+    return _byteswap_uint64(x);
+#else
+    return __builtin_bswap64(x);
+#endif
+#endif
+#endif
+}
+
+// Index of the highest bit set.
+inline unsigned log2(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return static_cast<unsigned>(index);
+#else
+    return 63 - static_cast<unsigned>(__builtin_clzll(x));
+#endif
+}
+
+// Id table segment number and position for id (counted from the first
+// id following base layer).
+inline std::pair<size_t, size_t> id_position(uint32_t id) {
+    constexpr size_t segment_size =
+        literal_dictionary::id_segment_initial_size;
+    auto segment_num = log2(id / segment_size + 1);
+    auto segment_begin = segment_size * ((size_t(1) << segment_num) - 1);
+    return {segment_num, id - segment_begin};
+}
+
+inline size_t id_segment_size(size_t segment_num) {
+    return literal_dictionary::id_segment_initial_size << segment_num;
+}
+
+// Prefetch memory for reading.
+inline void prefetch(const void* ptr) {
+#if defined(_MSC_VER)
+    _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+    __builtin_prefetch(ptr);
+#endif
+}
+
+// Unknown bucket tags (uninitialized or overflowed bucket).
+constexpr uint64_t unknown_tags = ~uint64_t(0);
+
+// Bucket tag: high hash bits (not used for bucket index) with the highest
+// tag bit set, so free tag slots are zero.
+inline uint64_t hash_tag(uint64_t hash) {
+    return (hash >> 57) | 0x80;
+}
+
+// Check if bucket tags may contain tag (SWAR zero byte search).
+inline bool has_tag(uint64_t tags, uint64_t tag) {
+    constexpr uint64_t lo = 0x0101010101010101ull;
+    constexpr uint64_t hi = 0x8080808080808080ull;
+    auto x = tags ^ (tag * lo);
+    return tags == unknown_tags || ((x - lo) & ~x & hi) != 0;
+}
+
+// Add tag to the first free slot (unknown tags if no slot left).
+inline uint64_t add_tag(uint64_t tags, uint64_t tag) {
+    for(unsigned shift = 0; shift < 64 && tags != unknown_tags; shift += 8) {
+        if(((tags >> shift) & 0xFF) == 0)
+            return tags | (tag << shift);
+    }
+    return unknown_tags;
 }
 
 } // namespace bits
 
-literal_dictionary::literal_dictionary() : mem_{pmr::get_default_resource()} {
+namespace {
+
+using bits::lock_mutex;
+
+// Live dictionaries, arenas of thread cache slots are returned only to
+// live ones.
+using dictionary_registry = bits::instance_registry<literal_dictionary>;
+
+// Thread local lookup cache entry: recently added string node.
+struct lookup_cache_entry {
+    uint64_t hash = 0;
+    const literal_dictionary_node* node = nullptr;
+};
+
+// Thread local lookup cache of dictionary (direct mapped by hash).
+struct thread_lookup_cache {
+    size_t size = 0;
+    std::unique_ptr<lookup_cache_entry[]> entries;
+};
+
+// Evicted lookup cache entries are kept for reuse.
+struct keep_lookup_cache {
+    bool operator()(uint64_t, thread_lookup_cache&, bool) const noexcept {
+        return true;
+    }
+};
+
+thread_local bits::thread_instance_cache<
+    thread_lookup_cache, keep_lookup_cache>
+    thread_lookup_caches;
+
+// Get lookup cache entries of dictionary for current thread,
+// new cache replaces the oldest one.
+lookup_cache_entry* thread_lookup_cache_entries(
+    uint64_t dict_id, size_t size) {
+    if(auto* cache = thread_lookup_caches.find(dict_id))
+        return cache->entries.get();
+    thread_lookup_caches.evict();
+    auto& cache = thread_lookup_caches.insert(dict_id);
+    // Replaced cache entries may refer to destroyed dictionary nodes.
+    if(cache.size != size) {
+        cache.entries.reset(new lookup_cache_entry[size]);
+        cache.size = size;
+    }
+    else {
+        std::fill_n(cache.entries.get(), size, lookup_cache_entry{});
+    }
+    return cache.entries.get();
+}
+
+#ifdef DICT_STRING_STATS
+// Statistics shard of thread (threads take shards round-robin).
+std::atomic<size_t> stats_thread_counter{0};
+thread_local size_t stats_thread_index = stats_thread_counter++;
+
+// Nanoseconds since start time.
+inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+}
+
+// Update relaxed maximum.
+inline void update_max(std::atomic<uint64_t>& max, uint64_t value) {
+    auto current = max.load(std::memory_order_relaxed);
+    while(current < value
+          && !max.compare_exchange_weak(
+              current, value, std::memory_order_relaxed))
+        ;
+}
+#endif
+
+// Uninitialized bucket marker.
+literal_dictionary_node uninitialized_bucket_node;
+literal_dictionary_node* const uninitialized_bucket =
+    &uninitialized_bucket_node;
+
+// Normalize batch of string keys by dictionary key policy, returns
+// source strings if they are canonical (buffer keeps normalized ones).
+const string_view* normalize_batch(
+    literal_dictionary::key_policy policy, const string_view* strs,
+    size_t count, string_view* keys, std::string& buffer) {
+    if(policy == literal_dictionary::key_policy::exact)
+        return strs;
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(bits::has_ascii_upper(strs[i]))
+            size += strs[i].size();
+    }
+    if(size == 0)
+        return strs;
+    buffer.resize(size);
+    auto* data = &buffer[0];
+    for(size_t i = 0; i < count; ++i) {
+        keys[i] = strs[i];
+        if(!bits::has_ascii_upper(strs[i]))
+            continue;
+        bits::ascii_fold(strs[i], data);
+        keys[i] = string_view(data, strs[i].size());
+        data += strs[i].size();
+    }
+    return keys;
+}
+
+// Round table size up to power of two.
+size_t table_size_ceil(size_t size) {
+    size_t table_size = literal_dictionary::min_table_initial_size;
+    while(table_size < size && table_size < literal_dictionary::max_table_size)
+        table_size <<= 1;
+    return table_size;
+}
+
+// Round lookup cache size up to power of two (0 stays disabled).
+size_t lookup_cache_size_ceil(size_t size) {
+    if(size == 0)
+        return 0;
+    size_t cache_size = 1;
+    while(cache_size < size
+          && cache_size < literal_dictionary::max_lookup_cache_size)
+        cache_size <<= 1;
+    return cache_size;
+}
+
+} // namespace
+
+// Return cached arena to its dictionary (if it is still alive).
+struct literal_dictionary::thread_arena_release {
+    bool operator()(uint64_t dict_id, node_arena_t* arena, bool wait) const {
+        return dictionary_registry::visit(
+            dict_id, wait, [&](literal_dictionary* dict) {
+                return dict->release_arena(arena, wait);
+            });
+    }
+};
+
+// Thread local arena cache for a few dictionaries.
+struct literal_dictionary::thread_arena_cache
+    : bits::thread_instance_cache<node_arena_t*, thread_arena_release> {};
+
+thread_local literal_dictionary::thread_arena_cache
+    literal_dictionary::thread_arenas_;
+
+literal_dictionary::literal_dictionary() : literal_dictionary(options{}) {
+}
+
+literal_dictionary::literal_dictionary(
+    const options& opts, pmr::memory_resource* mem)
+    : table_initial_size_{table_size_ceil(opts.table_initial_size)}
+    , table_policy_{opts.policy}
+    , key_policy_{opts.keys}
+    , lookup_cache_size_{lookup_cache_size_ceil(opts.lookup_cache_size)}
+    , max_segment_{&table_segments_[0]}
+    , instance_id_{bits::next_instance_id()}
+    , mem_{mem}
+    , chunk_size_{
+          std::max(opts.allocate_chunk_size, min_allocate_chunk_size)} {
+    // Last segment (the one reaching maximum table size) depends on
+    // initial table size.
+    for(auto size = table_initial_size_; size < max_table_size; size <<= 1)
+        ++max_segment_;
+    if(opts.snapshot_path != nullptr) {
+        base_ = std::make_unique<dictionary_snapshot>(opts.snapshot_path);
+    }
+    else if(opts.shared_snapshot_name != nullptr) {
+        base_ = std::make_unique<dictionary_snapshot>(
+            opts.shared_snapshot_name,
+            dictionary_snapshot::source::shared_memory);
+    }
+    if(base_ != nullptr && base_->keys() != key_policy_)
+        throw std::runtime_error("dictionary snapshot: other key policy");
+    if(base_ != nullptr)
+        size_.store(base_->count());
+    dictionary_registry::add(instance_id_, this);
+}
+
+literal_dictionary::literal_dictionary(
+    std::unique_ptr<const dictionary_snapshot> base, const options& opts,
+    pmr::memory_resource* mem)
+    : literal_dictionary(
+        [&opts] {
+            auto table_opts = opts;
+            table_opts.snapshot_path = nullptr;
+            table_opts.shared_snapshot_name = nullptr;
+            return table_opts;
+        }(),
+        mem) {
+    if(base != nullptr && base->keys() != key_policy_)
+        throw std::runtime_error("dictionary snapshot: other key policy");
+    base_ = std::move(base);
+    if(base_ != nullptr)
+        size_.store(base_->count());
+}
+
+// Global dictionary options.
+literal_dictionary::options& literal_dictionary::global_options() {
+    static options opts;
+    return opts;
 }
 
 // Dictionary singleton accessor.
 literal_dictionary& literal_dictionary::global() {
-    static literal_dictionary inst;
+    static literal_dictionary inst(global_options());
     return inst;
 }
 
 literal_dictionary::string literal_dictionary::add(string_view str) {
-    return string(get_node(str));
+    bits::normalized_key key(key_policy_, str);
+    if(string::is_inline_size(str.size()))
+        return string::make_inline(key.str());
+    return string(get_node(key.str()));
+}
+
+// Search/add string with precomputed hash.
+literal_dictionary::string literal_dictionary::add_hashed(
+    uint64_t hash, string_view str) {
+    bits::normalized_key key(key_policy_, str);
+    if(string::is_inline_size(str.size()))
+        return string::make_inline(key.str());
+    if(key.normalized())
+        return string(get_node(key.str()));
+    return string(get_node(hash, str));
 }
 
 // Add string to global dictionary.
 const char* literal_dictionary::add_global_str(string_view str) {
-    return global().get_node(str)->data();
+    auto& dict = global();
+    bits::normalized_key key(dict.key_policy_, str);
+    return dict.get_node(key.str())->data();
 }
 literal_dictionary::string literal_dictionary::add_global(string_view str) {
-    return string(global().get_node(str));
+    return global().add(str);
 }
 
 literal_dictionary::~literal_dictionary() {
+    // Arenas cached by threads are not returned after that.
+    dictionary_registry::remove(instance_id_);
     // Free hashtable memory.
     for(auto& segment : table_segments_) {
         if(segment.data == nullptr)
@@ -48,203 +353,977 @@ literal_dictionary::~literal_dictionary() {
             * sizeof(literal_dictionary_node::ptr);
         mem_->deallocate(
             segment.data, alloc_size, std::alignment_of<node_ptr_t>::value);
+        if(segment.tags != nullptr)
+            mem_->deallocate(
+                segment.tags, alloc_size,
+                std::alignment_of<bucket_tags_t>::value);
+    }
+    // Free id table memory.
+    for(size_t i = 0; i < id_segments_.size(); ++i) {
+        // Segments of base layer ids are not allocated.
+        auto* id_segment = id_segments_[i].load();
+        if(id_segment == nullptr)
+            continue;
+        mem_->deallocate(
+            id_segment, bits::id_segment_size(i) * sizeof(id_slot_t),
+            std::alignment_of<id_slot_t>::value);
     }
     // Free dictionary memory.
     auto* dict_page = allocated_pages_;
     while(dict_page) {
         auto* next = dict_page->next;
         mem_->deallocate(
-            dict_page, allocate_chunk_size,
-            std::alignment_of<node_ptr_t>::value);
+            dict_page, dict_page->size, std::alignment_of<dict_page_t>::value);
         dict_page = next;
     }
+    // Free allocation arenas.
+    auto* arena = arenas_;
+    while(arena) {
+        auto* next = arena->next;
+        arena->~node_arena_t();
+        mem_->deallocate(
+            arena, sizeof(node_arena_t),
+            std::alignment_of<node_arena_t>::value);
+        arena = next;
+    }
 }
 
 // Dictionary node search/add method.
 const literal_dictionary_node* literal_dictionary::get_node(string_view str) {
     if(str.empty())
-        return &empty_node;
-    auto hash = static_cast<uint32_t>(std::hash<string_view>()(str));
+        return &empty_node.node;
+    return get_node(dict_hash(str), str);
+}
+const literal_dictionary_node* literal_dictionary::get_node(
+    uint64_t hash, string_view str) {
+    if(str.empty())
+        return &empty_node.node;
+    if(lookup_cache_size_ == 0)
+        return find_or_add_node(hash, str);
+    // Entry hash is checked first to skip nodes of other strings.
+    auto* entries =
+        thread_lookup_cache_entries(instance_id_, lookup_cache_size_);
+    auto& entry = entries[(hash >> 32) & (lookup_cache_size_ - 1)];
+    if(entry.node != nullptr && entry.hash == hash
+       && entry.node->equals(str)) {
+        record_cache_lookup(true);
+        return entry.node;
+    }
+    record_cache_lookup(false);
+    const auto* node = find_or_add_node(hash, str);
+    entry.hash = hash;
+    entry.node = node;
+    return node;
+}
+
+// Search/add node in base layer and table (bypassing lookup cache).
+const literal_dictionary_node* literal_dictionary::find_or_add_node(
+    uint64_t hash, string_view str) {
+    if(const auto* node = find_base_node(hash, str))
+        return node;
     const auto* segment = current_segment_.load();
     if(segment != nullptr) {
         // Fast lock-free search.
-        auto table_size = segment->table_size;
-        auto bucket_num = hash % table_size;
-        while(bucket_num < segment->prev_table_size)
-            --segment;
-        auto segment_index = bucket_num - segment->prev_table_size;
-        auto* node = segment->data[segment_index].load();
-        while(node != nullptr) {
-            if(node->hash == hash && node->str() == str)
-                return node;
-            if((node->hash % table_size) != bucket_num)
-                break;
-            node = node->next.load();
+        if(const auto* node = find_node(segment, hash, str)) {
+            // Initialize bucket on first access if it doesn't block
+            // (new entry addition initializes bucket anyway).
+            auto bucket_num = bits::bucket_index(hash, segment->table_size);
+            if(bucket(segment, bucket_num).load() == uninitialized_bucket) {
+                std::unique_lock<std::mutex> lock(
+                    insert_locks_[hash & (insert_lock_count - 1)].mtx,
+                    std::try_to_lock);
+                if(lock.owns_lock())
+                    init_bucket(segment, bucket_num);
+            }
+            return node;
         }
     }
     // If node has not been found, add new one.
     return add_node(hash, str);
 }
 
+// Find node in snapshot base layer.
+const literal_dictionary_node* literal_dictionary::find_base_node(
+    uint64_t hash, string_view str) const {
+    return base_ != nullptr ? base_->find(hash, str) : nullptr;
+}
+
+// Base layer nodes count and node by id.
+size_t literal_dictionary::base_count() const noexcept {
+    return base_ != nullptr ? base_->count() : 0;
+}
+const literal_dictionary_node* literal_dictionary::base_node(
+    size_t id) const noexcept {
+    return base_->node(id);
+}
+
+// Allocated pages list head.
+const literal_dictionary::dict_page_t* literal_dictionary::first_page() const {
+    std::lock_guard<std::mutex> lock(alloc_mtx_);
+    return allocated_pages_;
+}
+
+// Split dictionary into disjoint ranges.
+std::vector<literal_dictionary::range> literal_dictionary::ranges(
+    size_t count) const {
+    count = std::max<size_t>(count, 1);
+    const auto* segment = current_segment_.load();
+    auto table_size = segment != nullptr ? segment->table_size : 0;
+    auto base_size = base_count();
+    std::vector<range> result;
+    result.reserve(count);
+    for(size_t i = 0; i < count; ++i)
+        result.push_back(range(
+            this, segment, table_size * i / count,
+            table_size * (i + 1) / count, base_size * i / count,
+            base_size * (i + 1) / count));
+    return result;
+}
+
+// Find node in table (lock-free).
+const literal_dictionary_node* literal_dictionary::find_node(
+    const dictionary_segment* segment, uint64_t hash, string_view str) const {
+    auto table_size = segment->table_size;
+    auto bucket_num = bits::bucket_index(hash, table_size);
+    // Tags filter out most missing strings without reading nodes.
+    if(segment->tags != nullptr
+       && !bits::has_tag(
+           bucket_tags(segment, bucket_num).load(), bits::hash_tag(hash))) {
+        record_lookup(0, false);
+        return nullptr;
+    }
+    const auto* node = bucket_first_node(segment, bucket_num);
+    uint64_t probes = 0;
+    while(node != nullptr
+          && bits::bucket_index(node->hash(), table_size) == bucket_num) {
+        ++probes;
+        if(node->hash() == hash && node->equals(str)) {
+            record_lookup(probes, true);
+            return node;
+        }
+        node = next_node(node);
+    }
+    record_lookup(probes, false);
+    return nullptr;
+}
+
+// Get bucket by number.
+literal_dictionary::node_ptr_t& literal_dictionary::bucket(
+    const dictionary_segment* segment, size_t bucket_num) const {
+    while(bucket_num < segment->prev_table_size)
+        --segment;
+    return segment->data[bucket_num - segment->prev_table_size];
+}
+
+// Get bucket tags by number (tagged table policy).
+literal_dictionary::bucket_tags_t& literal_dictionary::bucket_tags(
+    const dictionary_segment* segment, size_t bucket_num) const {
+    while(bucket_num < segment->prev_table_size)
+        --segment;
+    return segment->tags[bucket_num - segment->prev_table_size];
+}
+
+// Add node hash tag to bucket tags, requires bucket lock.
+void literal_dictionary::add_bucket_tag(
+    const dictionary_segment* segment, size_t bucket_num, uint64_t hash) {
+    auto& tags = bucket_tags(segment, bucket_num);
+    tags.store(bits::add_tag(tags.load(), bits::hash_tag(hash)));
+}
+
+// Find first node of the bucket (lock-free).
+// Uninitialized bucket nodes are searched in nearest initialized parent.
+const literal_dictionary_node* literal_dictionary::bucket_first_node(
+    const dictionary_segment* segment, size_t bucket_num) const {
+    auto table_size = segment->table_size;
+    auto parent_num = bucket_num;
+    const node_t* node = bucket(segment, parent_num).load();
+    while(node == uninitialized_bucket) {
+        // Parent bucket is bucket number without the highest bit,
+        // which is equal to previous table size of bucket segment.
+        while(parent_num < segment->prev_table_size)
+            --segment;
+        parent_num -= segment->prev_table_size;
+        node = bucket(segment, parent_num).load();
+    }
+    if(parent_num != bucket_num) {
+        // Skip parent nodes preceding the bucket in split order.
+        auto bucket_key = bits::reverse_bit_order(bucket_num);
+        while(node != nullptr
+              && bits::reverse_bit_order(
+                     bits::bucket_index(node->hash(), table_size))
+                  < bucket_key)
+            node = next_node(node);
+    }
+    if(node != nullptr
+       && bits::bucket_index(node->hash(), table_size) != bucket_num)
+        return nullptr;
+    return node;
+}
+
+// Initialize bucket from its parent bucket, requires bucket lock.
+// Parent and child buckets always share the same lock stripe.
+literal_dictionary_node* literal_dictionary::init_bucket(
+    const dictionary_segment* segment, size_t bucket_num) {
+    while(bucket_num < segment->prev_table_size)
+        --segment;
+    auto& slot = segment->data[bucket_num - segment->prev_table_size];
+    auto* node = slot.load();
+    if(node != uninitialized_bucket)
+        return node;
+    // Bucket nodes follow nodes remaining in parent bucket.
+    auto parent_num = bucket_num - segment->prev_table_size;
+    node = init_bucket(segment, parent_num);
+    uint64_t parent_tags = 0;
+    while(node != nullptr
+          && bits::bucket_index(node->hash(), segment->table_size)
+              == parent_num) {
+        parent_tags =
+            bits::add_tag(parent_tags, bits::hash_tag(node->hash()));
+        node = next_node(node);
+    }
+    if(segment->tags != nullptr) {
+        // Rebuild tags of split buckets: parent tags have tags of nodes
+        // moved to the bucket. Readers with outdated table size may miss
+        // parent nodes then, but they retry with current table size.
+        uint64_t tags = 0;
+        for(const auto* bucket_node = node;
+            bucket_node != nullptr
+            && bits::bucket_index(bucket_node->hash(), segment->table_size)
+                == bucket_num;
+            bucket_node = next_node(bucket_node))
+            tags =
+                bits::add_tag(tags, bits::hash_tag(bucket_node->hash()));
+        segment->tags[bucket_num - segment->prev_table_size].store(tags);
+        bucket_tags(segment, parent_num).store(parent_tags);
+    }
+    slot.store(node);
+    return node;
+}
+
+// Hash batch strings and prefetch their buckets.
+const literal_dictionary::dictionary_segment* literal_dictionary::hash_batch(
+    const string_view* strs, size_t count, uint64_t* hashes) const {
+    std::array<const node_ptr_t*, max_batch_size> buckets;
+    const auto* segment = current_segment_.load();
+    for(size_t i = 0; i < count; ++i) {
+        hashes[i] = dict_hash(strs[i]);
+        if(segment != nullptr) {
+            auto bucket_num =
+                bits::bucket_index(hashes[i], segment->table_size);
+            buckets[i] = &bucket(segment, bucket_num);
+            bits::prefetch(buckets[i]);
+        }
+    }
+    // Prefetch first bucket nodes.
+    if(segment != nullptr) {
+        for(size_t i = 0; i < count; ++i)
+            bits::prefetch(buckets[i]->load());
+    }
+    return segment;
+}
+
+// Dictionary batch search/add method.
+void literal_dictionary::add_many(
+    const string_view* strs, size_t count, string* result) {
+    std::array<uint64_t, max_batch_size> hashes;
+    std::array<size_t, max_batch_size> misses;
+    // Normalized keys of batch, if any.
+    std::array<string_view, max_batch_size> keys;
+    std::string buffer;
+    for(size_t offset = 0; offset < count; offset += max_batch_size) {
+        auto batch_count = std::min(max_batch_size, count - offset);
+        const auto* batch = normalize_batch(
+            key_policy_, strs + offset, batch_count, keys.data(), buffer);
+        auto* batch_result = result + offset;
+        for(size_t i = 0; i < batch_count; ++i) {
+            if(batch[i].size() > max_string_size())
+                throw std::runtime_error("dictionary dict_string to big");
+        }
+        const auto* segment = hash_batch(batch, batch_count, hashes.data());
+        // Lock-free search.
+        size_t miss_count = 0;
+        for(size_t i = 0; i < batch_count; ++i) {
+            if(string::is_inline_size(batch[i].size())) {
+                batch_result[i] = string::make_inline(batch[i]);
+                continue;
+            }
+            const node_t* node = nullptr;
+            if(batch[i].empty())
+                node = &empty_node.node;
+            else {
+                node = find_base_node(hashes[i], batch[i]);
+                if(node == nullptr && segment != nullptr)
+                    node = find_node(segment, hashes[i], batch[i]);
+            }
+            if(node != nullptr)
+                batch_result[i] = string(node);
+            else
+                misses[miss_count++] = i;
+        }
+        // Add missing strings, taking each insertion lock once.
+        auto lock_num = [&hashes](size_t i) {
+            return hashes[i] & (insert_lock_count - 1);
+        };
+        std::sort(
+            misses.begin(), misses.begin() + miss_count,
+            [&lock_num](size_t lhs, size_t rhs) {
+                return lock_num(lhs) < lock_num(rhs);
+            });
+        for(size_t i = 0; i < miss_count;) {
+            auto lock = lock_insert(hashes[misses[i]]);
+            auto current_lock = lock_num(misses[i]);
+            for(; i < miss_count && lock_num(misses[i]) == current_lock; ++i) {
+                auto pos = misses[i];
+                reserve_node();
+                batch_result[pos] =
+                    string(insert_node(hashes[pos], batch[pos]));
+            }
+        }
+    }
+}
+
+// Dictionary lookup, never adds new strings (lock-free).
+std::optional<literal_dictionary::string> literal_dictionary::find(
+    string_view str) const {
+    if(str.empty())
+        return string();
+    bits::normalized_key key(key_policy_, str);
+    str = key.str();
+    if(string::is_inline_size(str.size()))
+        return string::make_inline(str);
+    if(const auto* node = lookup_node(dict_hash(str), str))
+        return string(node);
+    return std::nullopt;
+}
+
+// Dictionary batch lookup, returns number of found strings.
+size_t literal_dictionary::find_many(
+    const string_view* strs, size_t count,
+    std::optional<string>* result) const {
+    std::array<uint64_t, max_batch_size> hashes;
+    std::array<string_view, max_batch_size> keys;
+    std::string buffer;
+    size_t found = 0;
+    for(size_t offset = 0; offset < count; offset += max_batch_size) {
+        auto batch_count = std::min(max_batch_size, count - offset);
+        const auto* batch = normalize_batch(
+            key_policy_, strs + offset, batch_count, keys.data(), buffer);
+        auto* batch_result = result + offset;
+        hash_batch(batch, batch_count, hashes.data());
+        for(size_t i = 0; i < batch_count; ++i) {
+            if(string::is_inline_size(batch[i].size())) {
+                batch_result[i] = string::make_inline(batch[i]);
+                ++found;
+                continue;
+            }
+            const node_t* node = batch[i].empty()
+                ? &empty_node.node
+                : lookup_node(hashes[i], batch[i]);
+            if(node != nullptr) {
+                batch_result[i] = string(node);
+                ++found;
+            }
+            else
+                batch_result[i] = std::nullopt;
+        }
+    }
+    return found;
+}
+
+// Find node in current table (lock-free).
+const literal_dictionary_node* literal_dictionary::lookup_node(
+    uint64_t hash, string_view str) const {
+    if(const auto* node = find_base_node(hash, str))
+        return node;
+    const auto* segment = current_segment_.load();
+    while(segment != nullptr) {
+        if(const auto* node = find_node(segment, hash, str))
+            return node;
+        // Node added after concurrent table growth may be unreachable
+        // with outdated table size, so retry with the current one.
+        const auto* current = current_segment_.load();
+        if(current == segment)
+            break;
+        segment = current;
+    }
+    return nullptr;
+}
+
 // Add new dictionary entry.
 literal_dictionary_node* literal_dictionary::add_node(
-    uint32_t hash, string_view str) {
-    if(str.size() > max_string_size)
+    uint64_t hash, string_view str) {
+    if(str.size() > max_string_size())
         throw std::runtime_error("dictionary dict_string to big");
-
-    // Insertion should be mutually exclusive otherwise
+    reserve_node();
+    // Insertion into the same bucket should be mutually exclusive otherwise
     // duplicate allocations of the same dict_string may occur.
-    std::lock_guard<std::mutex> lock(mtx_);
-    if(current_version_ == 0 && table_segments_[0].table_size == 0)
-        init_first_table_segment();
-    // Increase table when load factor = 1.
-    else if(
-        table_segments_[current_version_].table_size == size_
-        && current_version_ < table_segment_count - 1)
-        init_next_table_segment();
-
-    // Calculate bucket segment and segment position.
-    auto* segment = &table_segments_[current_version_];
+    // Lock stripe doesn't depend on table size (it divides table size).
+    auto lock = lock_insert(hash);
+    return insert_node(hash, str);
+}
+
+// Search/add string without waiting for other threads.
+std::optional<literal_dictionary::string> literal_dictionary::try_add(
+    string_view str) {
+    bits::normalized_key key(key_policy_, str);
+    str = key.str();
+    if(string::is_inline_size(str.size()))
+        return string::make_inline(str);
+    if(str.empty())
+        return string();
+    if(str.size() > max_string_size())
+        throw std::runtime_error("dictionary dict_string to big");
+    auto hash = dict_hash(str);
+    if(const auto* node = lookup_node(hash, str))
+        return string(node);
+    if(!reserve_node(false))
+        return std::nullopt;
+    std::unique_lock<std::mutex> lock(
+        insert_locks_[hash & (insert_lock_count - 1)].mtx, std::try_to_lock);
+    if(!lock.owns_lock())
+        return std::nullopt;
+    if(const auto* node = insert_node(hash, str, false))
+        return string(node);
+    return std::nullopt;
+}
+
+// Lock insertion stripe of hash.
+std::unique_lock<std::mutex> literal_dictionary::lock_insert(uint64_t hash) {
+    auto& mtx = insert_locks_[hash & (insert_lock_count - 1)].mtx;
+#ifdef DICT_STRING_STATS
+    std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+    if(!lock.owns_lock()) {
+        auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        auto& shard = stats_shard();
+        shard.lock_waits.fetch_add(1, std::memory_order_relaxed);
+        shard.lock_wait_ns.fetch_add(
+            elapsed_ns(start), std::memory_order_relaxed);
+    }
+    return lock;
+#else
+    return std::unique_lock<std::mutex>(mtx);
+#endif
+}
+
+// Prepare table for new node addition.
+bool literal_dictionary::reserve_node(bool wait) {
+    auto* segment = current_segment_.load();
+    // Increase table when load factor = 1 (base layer has own table).
+    if(segment != nullptr
+       && (segment->table_size + (base_ != nullptr ? base_->count() : 0)
+               > size_.load(std::memory_order_relaxed)
+           || segment == max_segment_))
+        return true;
+    std::unique_lock<std::mutex> lock(growth_mtx_, std::defer_lock);
+    if(!lock_mutex(lock, wait))
+        return false;
+    if(segment == nullptr) {
+        if(current_segment_.load() == nullptr)
+            init_first_table_segment();
+    }
+    else
+        grow_table(segment);
+    return true;
+}
+
+// Find or insert new dictionary entry, requires bucket lock.
+literal_dictionary_node* literal_dictionary::insert_node(
+    uint64_t hash, string_view str, bool wait) {
+    auto* segment = current_segment_.load();
     auto table_size = segment->table_size;
-    auto bucket_num = hash % table_size;
-    while(bucket_num < segment->prev_table_size)
-        --segment;
-    auto segment_index = bucket_num - segment->prev_table_size;
-    auto& bucket = segment->data[segment_index];
-    // Find bucket insertion point (using reverse bit order).
-    literal_dictionary_node* node = bucket.load();
+    auto bucket_num = bits::bucket_index(hash, table_size);
+    literal_dictionary_node* node = init_bucket(segment, bucket_num);
     literal_dictionary_node* prev = nullptr;
-    literal_dictionary_node* next = nullptr;
-    if(node != nullptr) {
-        auto shah = bits::reverse_bit_order(hash);
-        do {
-            // Check for bucket end.
-            if((node->hash % table_size) != bucket_num)
-                break;
-            // Check equal, may be already inserted by concurrent thread.
-            if(node->hash == hash && node->str() == str)
-                return node;
-            // Apply revers-bit ordering.
-            if(next == nullptr) {
-                auto node_shah = bits::reverse_bit_order(node->hash);
-                if(shah < node_shah)
-                    next = node;
-                else
-                    prev = node;
-            }
-            node = node->next.load();
-        } while(node != nullptr);
+    // Find bucket insertion point (using reverse bit order).
+    auto shah = bits::reverse_bit_order(hash);
+    while(node != nullptr
+          && bits::bucket_index(node->hash(), table_size) == bucket_num) {
+        // Check equal, may be already inserted by concurrent thread.
+        if(node->hash() == hash && node->equals(str))
+            return node;
+        if(shah < bits::reverse_bit_order(node->hash()))
+            break;
+        prev = node;
+        node = next_node(node);
+    }
+    // Just allocate new node and link it before the next node in split
+    // order, so the list is never cut for not yet initialized buckets.
+    if(size_.load(std::memory_order_relaxed) >= max_id)
+        throw std::runtime_error("dictionary size limit exceeded");
+    dict_page_t* page;
+    auto* new_node = allocate_node(hash, str, page, wait);
+    if(new_node == nullptr)
+        return nullptr;
+    link_node(new_node, node);
+    // Id and tag are registered before publishing node.
+    try {
+        new_node->id = claim_id(wait);
+        if(new_node->id != 0)
+            register_id(new_node);
     }
-    // Just allocate new node and add to list.
-    auto* new_node = allocate_node(hash, str);
-    new_node->next = next;
-    ++size_;
+    catch(...) {
+        unallocate_node(page, new_node);
+        throw;
+    }
+    if(new_node->id == 0) {
+        unallocate_node(page, new_node);
+        return nullptr;
+    }
+    record_insert();
+    if(segment->tags != nullptr)
+        add_bucket_tag(segment, bucket_num, hash);
     if(prev != nullptr)
-        prev->next.store(new_node);
+        link_node(prev, new_node);
     else
-        bucket.store(new_node);
+        bucket(segment, bucket_num).store(new_node);
+    // Publish node for page order scans.
+    page->used.store(
+        static_cast<size_t>(
+            new_node->data() + new_node->size() + 1
+            - reinterpret_cast<const char*>(page)),
+        std::memory_order_release);
     return new_node;
 }
 
-// Allocate new dictionary node.
+// Allocate new dictionary node (not published for page order scans).
 literal_dictionary_node* literal_dictionary::allocate_node(
-    uint32_t hash, string_view str) {
+    uint64_t hash, string_view str, dict_page_t*& page, bool wait) {
     constexpr size_t node_align =
         std::alignment_of<literal_dictionary_node>::value;
-    size_t node_size = sizeof(literal_dictionary_node) + str.size() + 1;
-    if(current_page_ != nullptr)
-        current_page_ =
-            std::align(node_align, node_size, current_page_, remain_page_size_);
-    // Allocate new page if no more space left.
-    if(current_page_ == nullptr) {
-        auto* page = static_cast<dict_page_t*>(mem_->allocate(
-            allocate_chunk_size, std::alignment_of<dict_page_t>::value));
-        total_allocated_size_ += allocate_chunk_size;
-        page->next = allocated_pages_;
-        allocated_pages_ = page;
-        current_page_ = page + 1;
-        remain_page_size_ = allocate_chunk_size - sizeof(dict_page_t);
-        current_page_ =
-            std::align(node_align, node_size, current_page_, remain_page_size_);
+    size_t node_size = node_t::node_size(str.size());
+    auto size_prefix = node_t::size_prefix(str.size());
+    void* place;
+    // Regular pages have no nodes with size prefix.
+    if(node_size > chunk_size_ / 4 || size_prefix != 0) {
+        page = allocate_large_page(node_size - size_prefix, wait);
+        if(page == nullptr)
+            return nullptr;
+        place = reinterpret_cast<char*>(page + 1) + node_t::max_size_prefix
+            - size_prefix;
+    }
+    else {
+        auto* arena = thread_arena(wait);
+        if(arena == nullptr)
+            return nullptr;
+        auto remain_page_size = arena->remain_page_size;
+        if(arena->current_page != nullptr)
+            arena->current_page = std::align(
+                node_align, node_size, arena->current_page,
+                arena->remain_page_size);
+        // Allocate new page if no more space left.
+        if(arena->current_page == nullptr) {
+            if(!allocate_page(arena, wait))
+                return nullptr;
+            remain_page_size += arena->remain_page_size;
+            arena->current_page = std::align(
+                node_align, node_size, arena->current_page,
+                arena->remain_page_size);
+        }
+        // Alignment padding and abandoned page tail.
+        record_page_waste(remain_page_size - arena->remain_page_size);
+        page = arena->page;
+        place = arena->current_page;
+        arena->current_page = static_cast<char*>(place) + node_size;
+        arena->remain_page_size -= node_size;
     }
     // Construct node and copy dict_string.
-    auto* node = reinterpret_cast<literal_dictionary_node*>(current_page_);
-    current_page_ = static_cast<char*>(current_page_) + node_size;
-    remain_page_size_ -= node_size;
-    new(node) literal_dictionary_node();
-    node->hash = hash;
-    node->size = static_cast<uint32_t>(str.size());
-    char* data = reinterpret_cast<char*>(node + 1);
+    auto* node = new(static_cast<char*>(place) + size_prefix)
+        literal_dictionary_node();
+    node->init(hash, str.size());
+    char* data = const_cast<char*>(node->data());
     std::char_traits<char>::copy(data, str.data(), str.size());
     data[str.size()] = '\0';
     return node;
 }
 
+// Return memory of the last node allocated by thread (not inserted).
+// Large node page stays unpublished (empty for page order scans).
+void literal_dictionary::unallocate_node(
+    dict_page_t* page, node_t* node) noexcept {
+    if(page->large)
+        return;
+    auto* arena = thread_arena();
+    auto* end = const_cast<char*>(node->data()) + node->size() + 1;
+    arena->remain_page_size += end - reinterpret_cast<char*>(node);
+    arena->current_page = node;
+}
+
+// Get allocation arena of current thread.
+literal_dictionary::node_arena_t* literal_dictionary::thread_arena(
+    bool wait) {
+    auto& cache = thread_arenas_;
+    if(auto* arena = cache.find(instance_id_))
+        return *arena;
+    // Take released arena or create new one, replacing the oldest cached
+    // one (returned to its dictionary with partially used page).
+    if(!cache.evict(wait))
+        return nullptr;
+    node_arena_t* arena;
+    {
+        std::unique_lock<std::mutex> lock(alloc_mtx_, std::defer_lock);
+        if(!lock_mutex(lock, wait))
+            return nullptr;
+        arena = free_arenas_;
+        if(arena != nullptr) {
+            free_arenas_ = arena->next_free;
+            arena->next_free = nullptr;
+        }
+        else {
+            arena = new(mem_->allocate(
+                sizeof(node_arena_t), std::alignment_of<node_arena_t>::value))
+                node_arena_t();
+            arena->next = arenas_;
+            arenas_ = arena;
+        }
+    }
+    cache.insert(instance_id_) = arena;
+    return arena;
+}
+
+// Return arena of evicted thread cache slot or exited thread.
+bool literal_dictionary::release_arena(node_arena_t* arena, bool wait) {
+    std::unique_lock<std::mutex> lock(alloc_mtx_, std::defer_lock);
+    if(!lock_mutex(lock, wait))
+        return false;
+    arena->next_free = free_arenas_;
+    free_arenas_ = arena;
+    return true;
+}
+
+// Allocate new page for arena.
+bool literal_dictionary::allocate_page(node_arena_t* arena, bool wait) {
+    std::unique_lock<std::mutex> lock(alloc_mtx_, std::defer_lock);
+    if(!lock_mutex(lock, wait))
+        return false;
+    auto* page = new(mem_->allocate(
+        chunk_size_, std::alignment_of<dict_page_t>::value)) dict_page_t();
+    total_allocated_size_ += chunk_size_;
+    page->used.store(sizeof(dict_page_t), std::memory_order_relaxed);
+    page->size = chunk_size_;
+    page->next = allocated_pages_;
+    allocated_pages_ = page;
+    arena->page = page;
+    arena->current_page = page + 1;
+    arena->remain_page_size = chunk_size_ - sizeof(dict_page_t);
+    return true;
+}
+
+// Allocate own chunk for large node (node size without size prefix).
+// Chunk is linked with regular pages (it is scanned and released as
+// page), node is published by its allocator.
+literal_dictionary::dict_page_t* literal_dictionary::allocate_large_page(
+    size_t node_size, bool wait) {
+    auto size = sizeof(dict_page_t) + node_t::max_size_prefix + node_size;
+    std::unique_lock<std::mutex> lock(alloc_mtx_, std::defer_lock);
+    if(!lock_mutex(lock, wait))
+        return nullptr;
+    auto* page = new(mem_->allocate(
+        size, std::alignment_of<dict_page_t>::value)) dict_page_t();
+    total_allocated_size_ += size;
+    page->used.store(sizeof(dict_page_t), std::memory_order_relaxed);
+    page->size = size;
+    page->large = true;
+    page->next = allocated_pages_;
+    allocated_pages_ = page;
+    return page;
+}
+
+// Get string by id.
+literal_dictionary::string literal_dictionary::at(uint32_t id) const {
+    const auto* node = id_node(id);
+    if(node == nullptr)
+        throw std::out_of_range("unknown dictionary string id");
+    return string(node);
+}
+
+// String id in this dictionary (inline strings are added to it).
+uint32_t literal_dictionary::id(const string& str) {
+    if(!str.is_inline())
+        return str.get_node().id;
+    bits::normalized_key key(key_policy_, str.ref());
+    return get_node(key.str())->id;
+}
+
+// Get node by id, returns nullptr for unknown ids.
+const literal_dictionary_node* literal_dictionary::id_node(uint32_t id) const {
+    if(id == 0)
+        return &empty_node.node;
+    auto base_size = base_count();
+    if(id <= base_size)
+        return base_->node(id);
+    auto pos = bits::id_position(id - static_cast<uint32_t>(base_size));
+    const auto* id_segment = id_segments_[pos.first].load();
+    return id_segment != nullptr ? id_segment[pos.second].load() : nullptr;
+}
+
+#ifdef DICT_STRING_COMPACT_NODE
+// Registered table node by id.
+literal_dictionary_node* literal_dictionary::table_node(
+    uint32_t id) const noexcept {
+    auto pos = bits::id_position(id - static_cast<uint32_t>(base_count()));
+    const auto* node = id_segments_[pos.first].load()[pos.second].load();
+    return const_cast<node_t*>(node);
+}
+#endif
+
+// Nodes with ids up to the first not yet registered id.
+std::vector<const literal_dictionary_node*>
+literal_dictionary::snapshot_nodes() const {
+    auto count = size_.load();
+    std::vector<const node_t*> nodes;
+    nodes.reserve(count);
+    for(size_t id = 1; id <= count; ++id) {
+        const auto* node = id_node(static_cast<uint32_t>(id));
+        if(node == nullptr)
+            break;
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+// Save dictionary strings with their ids to snapshot file.
+void literal_dictionary::save_snapshot(const char* path) const {
+    auto nodes = snapshot_nodes();
+    dictionary_snapshot::write(path, nodes.data(), nodes.size(), key_policy_);
+}
+
+// Publish dictionary snapshot as shared memory object.
+void literal_dictionary::publish_shared(const char* name) const {
+    auto nodes = snapshot_nodes();
+    dictionary_snapshot::publish(
+        name, nodes.data(), nodes.size(), key_policy_);
+}
+
+// Claim next string id.
+// Without waiting the id is claimed only after its id table segment is
+// allocated, so register_id takes no locks (ids are never skipped).
+uint32_t literal_dictionary::claim_id(bool wait) {
+    if(wait) {
+        return static_cast<uint32_t>(
+                   size_.fetch_add(1, std::memory_order_relaxed))
+            + 1;
+    }
+    auto size = size_.load(std::memory_order_relaxed);
+    do {
+        auto id = static_cast<uint32_t>(size) + 1;
+        if(id_table_segment(id, false) == nullptr)
+            return 0;
+    } while(!size_.compare_exchange_weak(
+        size, size + 1, std::memory_order_relaxed));
+    return static_cast<uint32_t>(size) + 1;
+}
+
+// Register node in id table.
+void literal_dictionary::register_id(const literal_dictionary_node* node) {
+    auto pos =
+        bits::id_position(node->id - static_cast<uint32_t>(base_count()));
+    id_table_segment(node->id, true)[pos.second].store(node);
+}
+
+// Id table segment of id, allocated if missing.
+// Table is indexed from the first id following base layer, so it grows
+// with added strings only.
+literal_dictionary::id_slot_t* literal_dictionary::id_table_segment(
+    uint32_t id, bool wait) {
+    auto pos = bits::id_position(id - static_cast<uint32_t>(base_count()));
+    auto& id_segment_ptr = id_segments_[pos.first];
+    auto* id_segment = id_segment_ptr.load();
+    if(id_segment != nullptr)
+        return id_segment;
+    std::unique_lock<std::mutex> lock(growth_mtx_, std::defer_lock);
+    if(!lock_mutex(lock, wait))
+        return nullptr;
+    id_segment = id_segment_ptr.load();
+    if(id_segment != nullptr)
+        return id_segment;
+    auto id_segment_size = bits::id_segment_size(pos.first);
+    {
+        std::unique_lock<std::mutex> alloc_lock(alloc_mtx_, std::defer_lock);
+        if(!lock_mutex(alloc_lock, wait))
+            return nullptr;
+        id_segment = static_cast<id_slot_t*>(mem_->allocate(
+            id_segment_size * sizeof(id_slot_t),
+            std::alignment_of<id_slot_t>::value));
+        total_allocated_size_ += id_segment_size * sizeof(id_slot_t);
+    }
+    std::uninitialized_fill_n(id_segment, id_segment_size, nullptr);
+    id_segment_ptr.store(id_segment);
+    return id_segment;
+}
+
 // Allocate data for new table segment (uninitialized).
 void literal_dictionary::allocate_table_segment(size_t segment_num) {
     auto& segment = table_segments_[segment_num];
     if(segment_num == 0)
-        segment.table_size = table_initial_size;
+        segment.table_size = table_initial_size_;
     else {
-        segment.prev_table_size = table_initial_size << (segment_num - 1);
+        segment.prev_table_size = table_initial_size_ << (segment_num - 1);
         segment.table_size = segment.prev_table_size << 1;
     }
     auto alloc_size = (segment.table_size - segment.prev_table_size)
         * sizeof(literal_dictionary_node::ptr);
+    std::lock_guard<std::mutex> lock(alloc_mtx_);
     segment.data = static_cast<node_ptr_t*>(
         mem_->allocate(alloc_size, std::alignment_of<node_ptr_t>::value));
     total_allocated_size_ += alloc_size;
+    if(table_policy_ == table_policy::tagged) {
+        segment.tags = static_cast<bucket_tags_t*>(mem_->allocate(
+            alloc_size, std::alignment_of<bucket_tags_t>::value));
+        total_allocated_size_ += alloc_size;
+    }
 }
 
 // Allocate and fill first table segment.
 void literal_dictionary::init_first_table_segment() {
     allocate_table_segment(0);
     std::uninitialized_fill_n(
-        table_segments_[0].data, table_initial_size, nullptr);
+        table_segments_[0].data, table_initial_size_, nullptr);
+    if(table_segments_[0].tags != nullptr)
+        std::uninitialized_fill_n(
+            table_segments_[0].tags, table_initial_size_, 0);
     current_segment_.store(&table_segments_[0]);
 }
 
-// Allocate and fill new table segment.
+// Allocate new table segment.
+// Buckets are left uninitialized and are split from their parent buckets
+// on first access, so growth doesn't walk the table.
 void literal_dictionary::init_next_table_segment() {
     allocate_table_segment(current_version_ + 1);
     auto& new_segment = table_segments_[current_version_ + 1];
-    auto old_table_size = table_segments_[current_version_].table_size;
-    auto new_table_size = new_segment.table_size;
-    // Iterate over all segments and split their buckets
-    // saving right part in new segment.
-    auto* segment = &table_segments_[0];
-    for(size_t i = 0; i < old_table_size; ++i) {
-        if(i >= segment->table_size)
-            ++segment;
-        auto segment_index = i - segment->prev_table_size;
-        literal_dictionary_node* right_bucket =
-            segment->data[segment_index].load();
-        // Find list split position.
-        while(right_bucket != nullptr
-              && (right_bucket->hash % old_table_size) == i
-              && (right_bucket->hash % new_table_size) == i)
-            right_bucket = right_bucket->next.load();
-        new(&new_segment.data[i]) node_ptr_t(right_bucket);
-    }
+    std::uninitialized_fill_n(
+        new_segment.data, new_segment.table_size - new_segment.prev_table_size,
+        uninitialized_bucket);
+    // Tags are built on bucket initialization.
+    if(new_segment.tags != nullptr)
+        std::uninitialized_fill_n(
+            new_segment.tags,
+            new_segment.table_size - new_segment.prev_table_size,
+            bits::unknown_tags);
     ++current_version_;
     current_segment_.store(&new_segment);
 }
 
+// Grow table if it still has specified segment as current.
+void literal_dictionary::grow_table(const dictionary_segment* segment) {
+    if(current_segment_.load() != segment)
+        return;
+#ifdef DICT_STRING_STATS
+    auto start = std::chrono::steady_clock::now();
+    init_next_table_segment();
+    record_growth(elapsed_ns(start));
+#else
+    init_next_table_segment();
+#endif
+}
+
+// Dictionary statistics.
+literal_dictionary::statistics literal_dictionary::stats() const {
+    statistics result;
+#ifdef DICT_STRING_STATS
+    for(const auto& shard : stats_shards_) {
+        auto load = [](const std::atomic<uint64_t>& counter) {
+            return counter.load(std::memory_order_relaxed);
+        };
+        result.lookups += load(shard.lookups);
+        result.hits += load(shard.hits);
+        result.inserts += load(shard.inserts);
+        result.probes += load(shard.probes);
+        result.max_probes = std::max(result.max_probes, load(shard.max_probes));
+        result.lock_waits += load(shard.lock_waits);
+        result.lock_wait_ns += load(shard.lock_wait_ns);
+        result.growths += load(shard.growths);
+        result.growth_ns += load(shard.growth_ns);
+        result.max_growth_ns =
+            std::max(result.max_growth_ns, load(shard.max_growth_ns));
+        result.page_waste_size += load(shard.page_waste_size);
+        result.cache_lookups += load(shard.cache_lookups);
+        result.cache_hits += load(shard.cache_hits);
+    }
+#endif
+    // Table and id segments are allocated under growth mutex.
+    std::lock_guard<std::mutex> lock(growth_mtx_);
+    for(const auto& segment : table_segments_) {
+        if(segment.data == nullptr)
+            break;
+        auto size = (segment.table_size - segment.prev_table_size)
+            * sizeof(node_ptr_t);
+        result.table_size += segment.tags != nullptr ? size * 2 : size;
+    }
+    for(size_t i = 0; i < id_segments_.size(); ++i) {
+        if(id_segments_[i].load() != nullptr)
+            result.id_table_size +=
+                bits::id_segment_size(i) * sizeof(id_slot_t);
+    }
+    std::lock_guard<std::mutex> alloc_lock(alloc_mtx_);
+    result.node_pages_size =
+        total_allocated_size_ - result.table_size - result.id_table_size;
+    return result;
+}
+
+#ifdef DICT_STRING_STATS
+// Statistics shard of current thread.
+literal_dictionary::stats_shard_t& literal_dictionary::stats_shard() const {
+    return stats_shards_[stats_thread_index % stats_shard_count];
+}
+
+void literal_dictionary::record_lookup(uint64_t probes, bool hit) const {
+    auto& shard = stats_shard();
+    shard.lookups.fetch_add(1, std::memory_order_relaxed);
+    if(hit)
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+    shard.probes.fetch_add(probes, std::memory_order_relaxed);
+    update_max(shard.max_probes, probes);
+}
+
+void literal_dictionary::record_insert() {
+    stats_shard().inserts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void literal_dictionary::record_growth(uint64_t ns) {
+    auto& shard = stats_shard();
+    shard.growths.fetch_add(1, std::memory_order_relaxed);
+    shard.growth_ns.fetch_add(ns, std::memory_order_relaxed);
+    update_max(shard.max_growth_ns, ns);
+}
+
+void literal_dictionary::record_page_waste(size_t size) {
+    stats_shard().page_waste_size.fetch_add(size, std::memory_order_relaxed);
+}
+
+void literal_dictionary::record_cache_lookup(bool hit) const {
+    auto& shard = stats_shard();
+    shard.cache_lookups.fetch_add(1, std::memory_order_relaxed);
+    if(hit)
+        shard.cache_hits.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
+
 literal_dictionary::iterator& literal_dictionary::iterator::operator++() {
     if(dict_ == nullptr)
         return *this;
+    // Base layer nodes go first in id order.
+    if(node_ == nullptr || base_id_ != 0) {
+        const auto* base = dict_->base_.get();
+        if(base != nullptr && base_id_ < base->count()) {
+            node_ = base->node(++base_id_);
+            return *this;
+        }
+        node_ = nullptr;
+        base_id_ = 0;
+    }
     if(node_ == nullptr) {
         bucket_position_ = 0;
         position_ = 0;
-        segment_ = &dict_->table_segments_[0];
         last_segment_ = dict_->current_segment_.load();
         if(last_segment_ == nullptr)
             return *this;
     }
     else {
-        node_ = node_->next.load();
+        node_ = dict_->next_node(node_);
         if(node_ != nullptr
-           && node_->hash % segment_->table_size == position_) {
+           && bits::bucket_index(node_->hash(), last_segment_->table_size)
+               == position_) {
             ++bucket_position_;
             return *this;
         }
@@ -252,16 +1331,10 @@ literal_dictionary::iterator& literal_dictionary::iterator::operator++() {
         bucket_position_ = 0;
         ++position_;
     }
-    while(node_ == nullptr) {
-        if(position_ >= segment_->table_size) {
-            if(segment_ == last_segment_)
-                return *this;
-            ++segment_;
-        }
-        node_ = segment_->data[position_ - segment_->prev_table_size].load();
-        if(node_ != nullptr && node_->hash % segment_->table_size == position_)
+    for(; position_ < last_segment_->table_size; ++position_) {
+        node_ = dict_->bucket_first_node(last_segment_, position_);
+        if(node_ != nullptr)
             return *this;
-        ++position_;
     }
     return *this;
 }
@@ -13,20 +13,58 @@
 // Hash table is stored as dynamically allocated segment array.
 // Each segment while added doubles total table size.
 // Therefore table segment size grows exponentialy: N, N, 2*N, 4*N, 8*N etc.
+//
+// New segment buckets are initialized lazily on first access by
+// splitting parent bucket (bucket number without the highest bit).
+//
+// Insertions are guarded by striped locks selected by bucket number,
+// so insertions into different bucket ranges don't contend. Bucket split
+// never moves node to another lock stripe. Table growth is the only
+// globally coordinated step.
+//
+// Tagged table policy keeps a word of 8 one-byte hash tags per bucket,
+// so most probes for missing strings end without touching nodes.
+//
+// Define DICT_STRING_INLINE to keep short strings (up to 6 chars on 64-bit
+// platforms) inline in dict_string value instead of dictionary. Inline
+// value is tagged by the lowest bit (dictionary string pointers are
+// aligned): tag byte (size << 1 | 1), chars and null terminator.
 
 #include <array>
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string_view>
-#ifdef _MSC_VER
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DICT_STRING_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DICT_STRING_NEON
+#endif
+#if defined(_MSC_VER) || __has_include(<memory_resource>)
 #include <memory_resource>
+#define DICT_STRING_STD_PMR
 #else
 #include <experimental/memory_resource>
 #endif
 
+#if defined(DICT_STRING_INLINE) && defined(__BYTE_ORDER__) \
+    && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "DICT_STRING_INLINE requires little endian platform"
+#endif
+
 namespace utils {
 
-#ifdef _MSC_VER
+#ifdef DICT_STRING_STD_PMR
 namespace pmr = std::pmr;
 #else
 namespace pmr = std::experimental::pmr;
@@ -34,99 +72,824 @@ namespace pmr = std::experimental::pmr;
 
 using string_view = std::string_view;
 
+namespace bits {
+
+// 64-bit multiplication, returns xor of 128-bit result halves.
+constexpr uint64_t mix64(uint64_t a, uint64_t b) noexcept {
+#if defined(__SIZEOF_INT128__)
+    auto r = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = uint32_t(a), lb = uint32_t(b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+// Little-endian unaligned reads (compiled to plain loads).
+constexpr uint64_t read64(const char* p) noexcept {
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; --i)
+        v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+constexpr uint64_t read32(const char* p) noexcept {
+    uint64_t v = 0;
+    for(int i = 3; i >= 0; --i)
+        v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+// wyhash (final version 4) string hash.
+//   https://github.com/wangyi-fudan/wyhash
+constexpr uint64_t wyhash(const char* p, size_t len, uint64_t seed) noexcept {
+    constexpr uint64_t s0 = 0x2d358dccaa6c78a5ull, s1 = 0x8bb84b93962eacc9ull,
+                       s2 = 0x4b33a62ed433d4a3ull, s3 = 0x4d5a2da51de1aa47ull;
+    seed ^= mix64(seed ^ s0, s1);
+    uint64_t a = 0, b = 0;
+    if(len <= 16) {
+        if(len >= 4) {
+            auto shift = (len >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + shift);
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - shift);
+        }
+        else if(len > 0) {
+            a = (uint64_t(static_cast<unsigned char>(p[0])) << 16)
+                | (uint64_t(static_cast<unsigned char>(p[len >> 1])) << 8)
+                | static_cast<unsigned char>(p[len - 1]);
+        }
+    }
+    else {
+        auto i = len;
+        if(i > 48) {
+            auto see1 = seed, see2 = seed;
+            do {
+                seed = mix64(read64(p) ^ s1, read64(p + 8) ^ seed);
+                see1 = mix64(read64(p + 16) ^ s2, read64(p + 24) ^ see1);
+                see2 = mix64(read64(p + 32) ^ s3, read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while(i > 16) {
+            seed = mix64(read64(p) ^ s1, read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= s1;
+    b ^= seed;
+#if defined(__SIZEOF_INT128__)
+    auto r = static_cast<unsigned __int128>(a) * b;
+    a = static_cast<uint64_t>(r);
+    b = static_cast<uint64_t>(r >> 64);
+#else
+    auto m = mix64(a, b);
+    a *= b;
+    b = m ^ a;
+#endif
+    return mix64(a ^ s0 ^ len, b ^ s1);
+}
+
+#if defined(DICT_STRING_SSE2)
+// Equal bytes mask of 16 bytes chunks.
+inline unsigned equal_mask16(const char* a, const char* b) noexcept {
+    auto va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    auto vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+}
+#elif defined(DICT_STRING_NEON)
+// Equality of 16 bytes chunks.
+inline bool equal16(const char* a, const char* b) noexcept {
+    auto eq = vceqq_u8(
+        vld1q_u8(reinterpret_cast<const uint8_t*>(a)),
+        vld1q_u8(reinterpret_cast<const uint8_t*>(b)));
+    return vminvq_u8(eq) == 0xFF;
+}
+#endif
+
+// Equality of sizeof(T) to 2 * sizeof(T) bytes: the first and the last
+// words overlap, so nothing is read beyond strings end.
+template<class T>
+inline bool equal_words(const char* a, const char* b, size_t size) noexcept {
+    T a_first, b_first, a_last, b_last;
+    std::memcpy(&a_first, a, sizeof(T));
+    std::memcpy(&b_first, b, sizeof(T));
+    std::memcpy(&a_last, a + size - sizeof(T), sizeof(T));
+    std::memcpy(&b_last, b + size - sizeof(T), sizeof(T));
+    return ((a_first ^ b_first) | (a_last ^ b_last)) == 0;
+}
+
+// Strings data equality (vectorized with SSE2 or NEON).
+// Loads are bounded by strings size (short strings are compared by
+// overlapping words, long ones by 16 bytes chunks with the last chunk
+// overlapping previous one), so any caller buffer may be compared.
+inline bool equal(const char* a, const char* b, size_t size) noexcept {
+    if(size < sizeof(uint32_t)) {
+        return size == 0
+            || (a[0] == b[0] && a[size / 2] == b[size / 2]
+                && a[size - 1] == b[size - 1]);
+    }
+    if(size < sizeof(uint64_t))
+        return equal_words<uint32_t>(a, b, size);
+    if(size <= 2 * sizeof(uint64_t))
+        return equal_words<uint64_t>(a, b, size);
+#if defined(DICT_STRING_SSE2)
+    for(size_t i = 0; i + 16 < size; i += 16) {
+        if(equal_mask16(a + i, b + i) != 0xFFFF)
+            return false;
+    }
+    return equal_mask16(a + size - 16, b + size - 16) == 0xFFFF;
+#elif defined(DICT_STRING_NEON)
+    for(size_t i = 0; i + 16 < size; i += 16) {
+        if(!equal16(a + i, b + i))
+            return false;
+    }
+    return equal16(a + size - 16, b + size - 16);
+#else
+    return std::memcmp(a, b, size) == 0;
+#endif
+}
+
+inline bool equal(string_view a, string_view b) noexcept {
+    return a.size() == b.size() && equal(a.data(), b.data(), a.size());
+}
+
+// ASCII upper case letters of 8 bytes: 0x20 in each letter byte.
+inline uint64_t ascii_upper_mask(uint64_t bytes) {
+    constexpr uint64_t lo = 0x0101010101010101ull;
+    constexpr uint64_t hi = 0x8080808080808080ull;
+    // Low 7 bits sums don't carry into next byte, high bit is the result.
+    auto low = bytes & ~hi;
+    auto ge_a = low + lo * (0x80 - 'A');
+    auto gt_z = low + lo * (0x80 - 'Z' - 1);
+    return (ge_a & ~gt_z & ~bytes & hi) >> 2;
+}
+
+// Check string for ASCII upper case letters (8 bytes at a time).
+inline bool has_ascii_upper(string_view str) {
+    size_t pos = 0;
+    for(; pos + sizeof(uint64_t) <= str.size(); pos += sizeof(uint64_t)) {
+        uint64_t bytes;
+        std::memcpy(&bytes, str.data() + pos, sizeof(bytes));
+        if(ascii_upper_mask(bytes) != 0)
+            return true;
+    }
+    for(; pos < str.size(); ++pos) {
+        if(str[pos] >= 'A' && str[pos] <= 'Z')
+            return true;
+    }
+    return false;
+}
+
+// Copy string with ASCII letters folded to lower case.
+inline void ascii_fold(string_view str, char* out) {
+    size_t pos = 0;
+    for(; pos + sizeof(uint64_t) <= str.size(); pos += sizeof(uint64_t)) {
+        uint64_t bytes;
+        std::memcpy(&bytes, str.data() + pos, sizeof(bytes));
+        bytes |= ascii_upper_mask(bytes);
+        std::memcpy(out + pos, &bytes, sizeof(bytes));
+    }
+    for(; pos < str.size(); ++pos) {
+        auto c = str[pos];
+        out[pos] = c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+    }
+}
+
+// Bucket number for hash (table size is power of two).
+inline size_t bucket_index(uint64_t hash, size_t table_size) {
+    return static_cast<size_t>(hash & (table_size - 1));
+}
+
+} // namespace bits
+
+// Dictionary string hash function.
+// Define DICT_STRING_STD_HASH to use std::hash<string_view> instead.
+#ifdef DICT_STRING_STD_HASH
+inline uint64_t dict_hash(string_view str) noexcept {
+    return std::hash<string_view>()(str);
+}
+#else
+constexpr uint64_t dict_hash(string_view str) noexcept {
+    return bits::wyhash(str.data(), str.size(), 0);
+}
+#endif
+
 // Dictionary intrusive linked node header.
 // String (null-terminated) is placed after header.
+//
+// With DICT_STRING_COMPACT_NODE defined header is 18 bytes aligned to 4
+// (instead of 24 aligned to 8): next node is referenced by id, hash is
+// split in 32-bit halves and string size is 16-bit, sizes of longer
+// strings are stored in 4 bytes preceding the node.
 struct literal_dictionary_node {
     using ptr = std::atomic<literal_dictionary_node*>;
-    constexpr literal_dictionary_node() noexcept
-        : next{nullptr}, hash{0}, size{0} {
+#ifdef DICT_STRING_COMPACT_NODE
+    // Next node id (0 for the list end).
+    using link = std::atomic<uint32_t>;
+    static constexpr size_t header_size = 18;
+    static constexpr size_t max_size_prefix = sizeof(uint32_t);
+    static constexpr uint16_t long_size = UINT16_MAX;
+#else
+    using link = ptr;
+    static constexpr size_t header_size = 24;
+    static constexpr size_t max_size_prefix = 0;
+#endif
+
+    constexpr literal_dictionary_node() noexcept = default;
+
+    // Size of memory preceding node header.
+    static constexpr size_t size_prefix(size_t size) noexcept {
+#ifdef DICT_STRING_COMPACT_NODE
+        return size >= long_size ? max_size_prefix : 0;
+#else
+        static_cast<void>(size);
+        return 0;
+#endif
+    }
+    // Node memory size (size prefix, header, string and terminator).
+    static constexpr size_t node_size(size_t size) noexcept {
+        return size_prefix(size) + header_size + size + 1;
+    }
+    // Node of unlinked (snapshot) node entry: size prefix is told from
+    // zero next link.
+    static const literal_dictionary_node* unlinked(const char* pos) noexcept {
+#ifdef DICT_STRING_COMPACT_NODE
+        uint32_t next;
+        std::memcpy(&next, pos, sizeof(next));
+        if(next != 0)
+            pos += max_size_prefix;
+#endif
+        return reinterpret_cast<const literal_dictionary_node*>(pos);
     }
-    ptr next;
-    uint32_t hash;
-    uint32_t size;
+
+#ifdef DICT_STRING_COMPACT_NODE
+    uint64_t hash() const noexcept {
+        return uint64_t(hash_high) << 32 | hash_low;
+    }
+    uint32_t size() const noexcept {
+        if(short_size != long_size)
+            return short_size;
+        uint32_t size;
+        std::memcpy(
+            &size, reinterpret_cast<const char*>(this) - max_size_prefix,
+            sizeof(size));
+        return size;
+    }
+    // Set hash and size (long size is written to node prefix).
+    void init(uint64_t hash, size_t size) noexcept {
+        hash_low = static_cast<uint32_t>(hash);
+        hash_high = static_cast<uint32_t>(hash >> 32);
+        if(size_prefix(size) == 0) {
+            short_size = static_cast<uint16_t>(size);
+            return;
+        }
+        short_size = long_size;
+        auto long_value = static_cast<uint32_t>(size);
+        std::memcpy(
+            reinterpret_cast<char*>(this) - max_size_prefix, &long_value,
+            sizeof(long_value));
+    }
+#else
+    uint64_t hash() const noexcept {
+        return hash_value;
+    }
+    uint32_t size() const noexcept {
+        return size_value;
+    }
+    void init(uint64_t hash, size_t size) noexcept {
+        hash_value = hash;
+        size_value = static_cast<uint32_t>(size);
+    }
+#endif
     const char* data() const {
-        return reinterpret_cast<const char*>(this + 1);
+        return reinterpret_cast<const char*>(this) + header_size;
     }
     string_view str() const {
-        return {data(), size};
+        return {data(), size()};
+    }
+    bool equals(string_view rhs) const noexcept {
+        return size() == rhs.size()
+            && bits::equal(data(), rhs.data(), rhs.size());
     }
+
+#ifdef DICT_STRING_COMPACT_NODE
+    link next{0};
+    // Dense sequential string id (empty string has id 0).
+    uint32_t id = 0;
+    uint32_t hash_low = 0;
+    uint32_t hash_high = 0;
+    uint16_t short_size = 0;
+    // String start (header tail padding).
+    char chars[2] = {};
+#else
+    link next{nullptr};
+    uint64_t hash_value = 0;
+    uint32_t size_value = 0;
+    // Dense sequential string id (empty string has id 0).
+    uint32_t id = 0;
+#endif
 };
 
+#ifdef DICT_STRING_COMPACT_NODE
+static_assert(
+    offsetof(literal_dictionary_node, chars)
+        == literal_dictionary_node::header_size,
+    "compact node string offset");
+#else
+static_assert(
+    sizeof(literal_dictionary_node) == literal_dictionary_node::header_size,
+    "node string offset");
+#endif
+
 // Empty node for default dict_string initialization.
-struct empty_literal_dictionary_node : literal_dictionary_node {
-    constexpr empty_literal_dictionary_node() noexcept : term{0} {
+// Header is a member (not a base), so terminator is never placed
+// in header tail padding and always follows the header (compact node
+// string starts in header padding).
+struct empty_literal_dictionary_node {
+    constexpr empty_literal_dictionary_node() noexcept : node{}, term{0} {
     }
+    constexpr const char* str() const noexcept {
+#ifdef DICT_STRING_COMPACT_NODE
+        return node.chars;
+#else
+        return &term;
+#endif
+    }
+    literal_dictionary_node node;
     const char term;
 };
 
+class dictionary_snapshot;
+
 // String literal dictionary.
 class literal_dictionary {
     using node_t = literal_dictionary_node;
     using node_ptr_t = node_t::ptr;
 
+    // Insertion lock, padded to separate cache lines.
+    struct alignas(64) insert_lock_t {
+        std::mutex mtx;
+    };
+
+    // Id table segment.
+    using id_slot_t = std::atomic<const literal_dictionary_node*>;
+
+    // Bucket hash tags word (tagged table policy).
+    using bucket_tags_t = std::atomic<uint64_t>;
+
     // Dictionary table segment.
     struct dictionary_segment {
         literal_dictionary_node::ptr* data = nullptr;
+        // Bucket tags parallel to data (tagged table policy only).
+        bucket_tags_t* tags = nullptr;
         size_t table_size = 0;
         size_t prev_table_size = 0;
     };
 
     // Allocated memory chunk header.
-    // Used for collecting allocated dictionary pages.
+    // Used for collecting allocated dictionary pages and page order scans
+    // (used size covers inserted nodes: linked, with ids). Large nodes get
+    // their own chunks of node size, the node follows maximum size prefix.
     struct dict_page_t {
-        dict_page_t* next;
+        dict_page_t* next = nullptr;
+        std::atomic<size_t> used{0};
+        size_t size = 0;
+        bool large = false;
     };
 
+    // Per-thread node allocation arena.
+    // Each thread carves nodes from its own current page without locking.
+    // Arenas are linked for destruction and padded to separate cache lines,
+    // arenas released by threads (with their partially used pages) are
+    // reused by other threads.
+    struct alignas(64) node_arena_t {
+        node_arena_t* next = nullptr;
+        node_arena_t* next_free = nullptr;
+        dict_page_t* page = nullptr;
+        void* current_page = nullptr;
+        size_t remain_page_size = 0;
+    };
+
+#ifdef DICT_STRING_STATS
+    // Statistics counters shard, padded to separate cache lines.
+    struct alignas(64) stats_shard_t {
+        std::atomic<uint64_t> lookups{0};
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> inserts{0};
+        std::atomic<uint64_t> probes{0};
+        std::atomic<uint64_t> max_probes{0};
+        std::atomic<uint64_t> lock_waits{0};
+        std::atomic<uint64_t> lock_wait_ns{0};
+        std::atomic<uint64_t> growths{0};
+        std::atomic<uint64_t> growth_ns{0};
+        std::atomic<uint64_t> max_growth_ns{0};
+        std::atomic<uint64_t> page_waste_size{0};
+        std::atomic<uint64_t> cache_lookups{0};
+        std::atomic<uint64_t> cache_hits{0};
+    };
+#endif
+
 public:
     class string;
     class iterator;
+    class range;
 
     // Common empty node instance.
     constexpr static inline empty_literal_dictionary_node empty_node{};
 
-    // Dictionary allocation chunk, 64K.
-    static constexpr size_t allocate_chunk_size = 64 * 1024;
+    // Default dictionary allocation chunk, 64K.
+    static constexpr size_t default_allocate_chunk_size = 64 * 1024;
+
+    // Minimal dictionary allocation chunk.
+    static constexpr size_t min_allocate_chunk_size = 4 * 1024;
+
+    // Default initial dictionary hashtable size, 64K (8K nodes).
+    static constexpr size_t default_table_initial_size =
+        default_allocate_chunk_size / sizeof(node_ptr_t);
+
+    // Former names of defaults (options set actual values).
+    [[deprecated("use default_allocate_chunk_size")]] static constexpr size_t
+        allocate_chunk_size = default_allocate_chunk_size;
+    [[deprecated("use default_table_initial_size")]] static constexpr size_t
+        table_initial_size = default_table_initial_size;
 
-    // Initial dictionary hashtable size, 64K (8K nodes).
-    static constexpr size_t table_initial_size =
-        allocate_chunk_size / sizeof(node_ptr_t);
+    // Number of insertion lock stripes (divides table size).
+    static constexpr size_t insert_lock_count = 64;
 
-    // Maximum table segment index.
-    // Maximum table size equals table_initial_size * 2 ^ table_segment_count.
-    static constexpr size_t table_segment_count = 16;
+    // Minimal initial hashtable size.
+    static constexpr size_t min_table_initial_size = insert_lock_count;
 
-    // Dictionary strings size limit (should fit in memory chunk).
-    static constexpr size_t max_string_size = allocate_chunk_size
-        - sizeof(dict_page_t) - sizeof(literal_dictionary_node);
+    // Maximum per-thread lookup cache size (entries).
+    static constexpr size_t max_lookup_cache_size = size_t(1) << 20;
+
+    // Maximum table size covers the full hash space.
+    static constexpr size_t max_table_size = size_t(1) << 32;
+
+    // Table segment count enough to reach maximum table size
+    // from minimal initial table size.
+    static constexpr size_t table_segment_count = 32 - 6 + 1;
+    static_assert(
+        (min_table_initial_size << (table_segment_count - 1))
+        == max_table_size);
+
+    // Id table first segment size, id table grows by segments
+    // doubling total size like hashtable: N, N, 2*N, 4*N, etc.
+    static constexpr size_t id_segment_initial_size = 4096;
+
+    // Maximum string id, limits dictionary size.
+    static constexpr uint32_t max_id = UINT32_MAX;
+
+    // Id table segment count enough for maximum id.
+    static constexpr size_t id_segment_count = 32 - 12 + 1;
+
+    // Hashtable lookup policy.
+    enum class table_policy {
+        // Bucket node chains only.
+        chained,
+        // Bucket hash tags are checked before bucket nodes
+        // (table memory is doubled).
+        tagged
+    };
+
+    // String key normalization: strings equal after normalization are
+    // the same dictionary string, which keeps the canonical form.
+    enum class key_policy {
+        // Strings are compared byte by byte.
+        exact,
+        // ASCII letters are folded to lower case (HTTP header names, DNS
+        // labels), other bytes are compared as is.
+        ascii_icase
+    };
+
+    // Dictionary construction options.
+    struct options {
+        // Initial hashtable size (rounded up to power of two).
+        size_t table_initial_size = default_table_initial_size;
+        // Node pages allocation chunk size (limits string size).
+        // Use huge page size with huge page backed memory resource.
+        size_t allocate_chunk_size = default_allocate_chunk_size;
+        // Hashtable lookup policy.
+        table_policy policy = table_policy::chained;
+        // String key normalization (snapshot base layer should have the
+        // same key policy, checked on load).
+        key_policy keys = key_policy::exact;
+        // Snapshot file mapped as read-only dictionary base layer
+        // (see save_snapshot), new strings get ids following its ids.
+        const char* snapshot_path = nullptr;
+        // Shared memory snapshot name (see publish_shared), used as base
+        // layer if snapshot_path is not set.
+        const char* shared_snapshot_name = nullptr;
+        // Per-thread cache of recently added strings in front of table
+        // lookup (entries, rounded up to power of two), 0 disables it.
+        // Pays off for skewed workloads repeating a hot set of strings.
+        size_t lookup_cache_size = 0;
+    };
+
+    // Batch operations chunk size.
+    static constexpr size_t max_batch_size = 64;
+
+
+    // Statistics counters are collected with DICT_STRING_STATS defined
+    // (zero otherwise), memory sizes are always available.
+#ifdef DICT_STRING_STATS
+    static constexpr bool stats_enabled = true;
+#else
+    static constexpr bool stats_enabled = false;
+#endif
+
+    // Number of statistics counters shards (threads are spread over them).
+    static constexpr size_t stats_shard_count = 16;
+
+    // Dictionary statistics.
+    struct statistics {
+        // Table searches (lock-free lookups of add and find), found ones
+        // and new strings inserted.
+        uint64_t lookups = 0;
+        uint64_t hits = 0;
+        uint64_t inserts = 0;
+        // Nodes compared in bucket chains, and maximum per search.
+        uint64_t probes = 0;
+        uint64_t max_probes = 0;
+        // Contended insertion locks and time waiting for them.
+        uint64_t lock_waits = 0;
+        uint64_t lock_wait_ns = 0;
+        // Table growth events and their duration.
+        uint64_t growths = 0;
+        uint64_t growth_ns = 0;
+        uint64_t max_growth_ns = 0;
+        // Allocated memory: node pages, bucket table (with tags), id table.
+        size_t node_pages_size = 0;
+        size_t table_size = 0;
+        size_t id_table_size = 0;
+        // Node pages memory lost for alignment and unused page tails.
+        size_t page_waste_size = 0;
+        // Thread lookup cache searches of add and found ones.
+        uint64_t cache_lookups = 0;
+        uint64_t cache_hits = 0;
+
+        uint64_t misses() const noexcept {
+            return lookups - hits;
+        }
+        double cache_hit_rate() const noexcept {
+            return cache_lookups != 0 ? double(cache_hits) / cache_lookups
+                                      : 0;
+        }
+        double average_probes() const noexcept {
+            return lookups != 0 ? double(probes) / lookups : 0;
+        }
+    };
 
     static constexpr const char* empty_str() {
-        return &literal_dictionary::empty_node.term;
+        return literal_dictionary::empty_node.str();
     }
 
+    // Independent dictionary instance.
+    // All dictionary memory is allocated from specified memory resource
+    // and released on dictionary destruction.
+    literal_dictionary();
+    explicit literal_dictionary(
+        const options& opts,
+        pmr::memory_resource* mem = pmr::get_default_resource());
+    // Frozen dictionary: base layer is prebuilt snapshot (see
+    // dictionary_snapshot::build), its strings are found without table
+    // atomics, later strings are added to regular pages (snapshot options
+    // are ignored).
+    literal_dictionary(
+        std::unique_ptr<const dictionary_snapshot> base, const options& opts,
+        pmr::memory_resource* mem = pmr::get_default_resource());
+    ~literal_dictionary();
+
+    literal_dictionary(const literal_dictionary&) = delete;
+    literal_dictionary& operator=(const literal_dictionary&) = delete;
+
+    // Dictionary strings size limit (node size is 32-bit).
+    // Strings larger than a quarter of memory chunk are allocated in own
+    // chunks, so pages are not abandoned half-filled.
+    // Called as max_string_size(), former constant use converts.
+    struct max_string_size_t {
+        constexpr size_t operator()() const noexcept {
+            return UINT32_MAX;
+        }
+        [[deprecated("use max_string_size()")]] constexpr
+        operator size_t() const noexcept {
+            return UINT32_MAX;
+        }
+    };
+    static constexpr max_string_size_t max_string_size{};
+
     // Dictionary iteration.
     iterator begin() const;
     iterator end() const;
 
+    // Split dictionary into count disjoint ranges (by buckets of current
+    // table and base layer ids) for partitioned iteration. Ranges may be
+    // visited concurrently with lookups and insertions (strings added
+    // concurrently may be skipped).
+    std::vector<range> ranges(size_t count) const;
+
+    // Visit all strings with fn(string) from thread_count threads
+    // (fn is called concurrently and should not throw).
+    template<class Fn>
+    void parallel_for_each(size_t thread_count, Fn&& fn) const;
+
+    // Visit all strings with fn(string) in node pages memory order
+    // (unspecified order, sequential memory access for bulk scans).
+    template<class Fn>
+    void for_each_page_order(Fn&& fn) const;
+
+    // Number of dictionary strings (excluding empty string).
+    size_t size() const noexcept {
+        return size_.load();
+    }
+
+    // Get string by id, throws std::out_of_range for unknown ids.
+    string at(uint32_t id) const;
+
+    // String id in this dictionary (inline strings are added to it).
+    uint32_t id(const string& str);
+
+    // Dictionary statistics (counters are summed over shards).
+    statistics stats() const;
+
+    // Save dictionary strings with their ids to snapshot file.
+    // Strings added concurrently may be omitted (snapshot keeps ids
+    // sequence up to the first not yet registered id).
+    void save_snapshot(const char* path) const;
+
+    // Publish dictionary snapshot as POSIX shared memory object,
+    // other processes attach it read-only as their base layer.
+    void publish_shared(const char* name) const;
+
     // Dictionary node search/add method.
     string add(string_view str);
 
+    // Search/add string with precomputed hash (should be dict_hash(str)),
+    // used for strings hashed at compile time.
+    string add_hashed(uint64_t hash, string_view str);
+
+    // Search/add string without waiting for other threads: returns
+    // nullopt if string is missing and table growth, its insertion lock or
+    // allocation lock (new page or id table segment) is held by other
+    // thread.
+    std::optional<string> try_add(string_view str);
+
+    // Dictionary batch search/add method.
+    // All strings are hashed and their buckets are prefetched before search,
+    // missing strings are added taking each insertion lock once.
+    void add_many(const string_view* strs, size_t count, string* result);
+
+    // Dictionary lookup, never adds new strings (lock-free).
+    // Inline strings are always found.
+    std::optional<string> find(string_view str) const;
+
+    // Dictionary batch lookup, returns number of found strings.
+    size_t find_many(
+        const string_view* strs, size_t count,
+        std::optional<string>* result) const;
+
     // Global dictionary operations.
+    // Global dictionary options should be set before its first use.
+    static options& global_options();
     static literal_dictionary& global();
     static const char* add_global_str(string_view str);
     static string add_global(string_view str);
 
 private:
-    literal_dictionary();
-    ~literal_dictionary();
-
     // Dictionary node search/add method.
     const literal_dictionary_node* get_node(string_view str);
+    const literal_dictionary_node* get_node(uint64_t hash, string_view str);
+    // Search/add node in base layer and table (bypassing lookup cache).
+    const literal_dictionary_node* find_or_add_node(
+        uint64_t hash, string_view str);
+
+    // Find node in snapshot base layer.
+    const literal_dictionary_node* find_base_node(
+        uint64_t hash, string_view str) const;
+
+    // Base layer nodes count and node by id (1..count).
+    size_t base_count() const noexcept;
+    const literal_dictionary_node* base_node(size_t id) const noexcept;
+
+    // Allocated pages list head (pages are added to list head).
+    const dict_page_t* first_page() const;
+
+    // Get node by id, returns nullptr for unknown ids.
+    const literal_dictionary_node* id_node(uint32_t id) const;
+
+    // Next node in table list (compact nodes link next node by id).
+    node_t* next_node(const node_t* node) const noexcept {
+#ifdef DICT_STRING_COMPACT_NODE
+        auto id = node->next.load();
+        return id != 0 ? table_node(id) : nullptr;
+#else
+        return node->next.load();
+#endif
+    }
+    // Link next node in table list.
+    static void link_node(node_t* node, node_t* next) noexcept {
+#ifdef DICT_STRING_COMPACT_NODE
+        node->next.store(next != nullptr ? next->id : 0);
+#else
+        node->next.store(next);
+#endif
+    }
+#ifdef DICT_STRING_COMPACT_NODE
+    // Registered table node by id.
+    node_t* table_node(uint32_t id) const noexcept;
+#endif
+
+    // Nodes with ids up to the first not yet registered id.
+    std::vector<const literal_dictionary_node*> snapshot_nodes() const;
+
+    // Find node in current table (lock-free).
+    const literal_dictionary_node* lookup_node(
+        uint64_t hash, string_view str) const;
+
+    // Hash batch strings and prefetch their buckets.
+    const dictionary_segment* hash_batch(
+        const string_view* strs, size_t count, uint64_t* hashes) const;
+
+    // Find node in table (lock-free).
+    const literal_dictionary_node* find_node(
+        const dictionary_segment* segment, uint64_t hash,
+        string_view str) const;
+
+    // Get bucket by number.
+    node_ptr_t& bucket(
+        const dictionary_segment* segment, size_t bucket_num) const;
+
+    // Get bucket tags by number (tagged table policy).
+    bucket_tags_t& bucket_tags(
+        const dictionary_segment* segment, size_t bucket_num) const;
+
+    // Add node hash tag to bucket tags, requires bucket lock.
+    void add_bucket_tag(
+        const dictionary_segment* segment, size_t bucket_num, uint64_t hash);
+
+    // Find first node of the bucket (lock-free).
+    const literal_dictionary_node* bucket_first_node(
+        const dictionary_segment* segment, size_t bucket_num) const;
+
+    // Initialize bucket from its parent bucket, requires bucket lock.
+    literal_dictionary_node* init_bucket(
+        const dictionary_segment* segment, size_t bucket_num);
 
     // Add new dictionary entry.
-    literal_dictionary_node* add_node(uint32_t hash, string_view str);
+    literal_dictionary_node* add_node(uint64_t hash, string_view str);
+
+    // Prepare table for new node addition, returns false without waiting
+    // if table growth is required and growth lock is held.
+    bool reserve_node(bool wait = true);
+
+    // Find or insert new dictionary entry, requires bucket lock.
+    // Returns nullptr instead of waiting for allocation if wait is false.
+    literal_dictionary_node* insert_node(
+        uint64_t hash, string_view str, bool wait = true);
+
+    // Allocate new dictionary node (not published for page order scans),
+    // returns nullptr if allocation lock is held and wait is false.
+    literal_dictionary_node* allocate_node(
+        uint64_t hash, string_view str, dict_page_t*& page, bool wait);
+
+    // Return memory of the last node allocated by thread (not inserted).
+    void unallocate_node(dict_page_t* page, node_t* node) noexcept;
+
+    // Get allocation arena of current thread (nullptr if it requires
+    // held lock and wait is false).
+    node_arena_t* thread_arena(bool wait = true);
 
-    // Allocate new dictionary node.
-    literal_dictionary_node* allocate_node(uint32_t hash, string_view str);
+    // Return arena of evicted thread cache slot or exited thread.
+    bool release_arena(node_arena_t* arena, bool wait);
+
+    // Thread arena cache (returns arenas to their dictionaries on slot
+    // eviction and thread exit).
+    struct thread_arena_release;
+    struct thread_arena_cache;
+    static thread_local thread_arena_cache thread_arenas_;
+
+    // Allocate new page for arena (false if lock is held and wait is false).
+    bool allocate_page(node_arena_t* arena, bool wait);
+
+    // Allocate own chunk for large node.
+    dict_page_t* allocate_large_page(size_t node_size, bool wait);
+
+    // Claim next string id (0 if it requires held lock and wait is false).
+    uint32_t claim_id(bool wait);
+
+    // Register node in id table.
+    void register_id(const literal_dictionary_node* node);
+
+    // Id table segment of id, allocated if missing.
+    id_slot_t* id_table_segment(uint32_t id, bool wait);
 
     // Allocate data for new table segment (uninitialized).
     void allocate_table_segment(size_t segment_num);
@@ -134,79 +897,148 @@ private:
     // Allocate and fill first table segment.
     void init_first_table_segment();
 
-    // Allocate and fill new table segment.
+    // Allocate new table segment (buckets are initialized lazily).
     void init_next_table_segment();
 
+    // Grow table if it still has specified segment as current,
+    // requires growth lock.
+    void grow_table(const dictionary_segment* segment);
+
+    // Lock insertion stripe of hash (lock waits are counted).
+    std::unique_lock<std::mutex> lock_insert(uint64_t hash);
+
+    // Statistics counters (no-op without DICT_STRING_STATS).
+#ifdef DICT_STRING_STATS
+    stats_shard_t& stats_shard() const;
+    void record_lookup(uint64_t probes, bool hit) const;
+    void record_insert();
+    void record_growth(uint64_t ns);
+    void record_page_waste(size_t size);
+    void record_cache_lookup(bool hit) const;
+#else
+    void record_lookup(uint64_t, bool) const {
+    }
+    void record_insert() {
+    }
+    void record_page_waste(size_t) {
+    }
+    void record_cache_lookup(bool) const {
+    }
+#endif
+
 private:
     std::atomic<dictionary_segment*> current_segment_{nullptr};
-    // Dictionary size.
-    size_t size_ = 0;
+    // Dictionary size (including base layer).
+    std::atomic<size_t> size_{0};
+    // Read-only base layer.
+    std::unique_ptr<const dictionary_snapshot> base_;
     // Current table version (max segment number).
     size_t current_version_{0};
+    // Initial table size (power of two).
+    const size_t table_initial_size_;
+    const table_policy table_policy_;
+    const key_policy key_policy_;
+    // Thread lookup cache size (power of two or 0).
+    const size_t lookup_cache_size_;
+    // Last table segment reaching maximum table size.
+    const dictionary_segment* max_segment_;
     // Hashtable segment array.
     std::array<dictionary_segment, table_segment_count> table_segments_;
-    // Mutex for adding new strings to dictionary.
-    std::mutex mtx_;
-    // Memory allocation stuff.
+    // Id table segments (allocated under growth mutex).
+    std::array<std::atomic<id_slot_t*>, id_segment_count> id_segments_{};
+    // Striped locks for adding new strings to dictionary.
+    std::array<insert_lock_t, insert_lock_count> insert_locks_;
+    // Mutex for table growth.
+    mutable std::mutex growth_mtx_;
+    // Unique dictionary instance id (thread arena and lookup cache key).
+    const uint64_t instance_id_;
+    // Memory allocation stuff (guarded by alloc_mtx_).
+    mutable std::mutex alloc_mtx_;
     pmr::memory_resource* mem_;
+    const size_t chunk_size_;
     dict_page_t* allocated_pages_ = nullptr;
-    void* current_page_ = nullptr;
-    size_t remain_page_size_ = 0;
+    node_arena_t* arenas_ = nullptr;
+    node_arena_t* free_arenas_ = nullptr;
     size_t total_allocated_size_ = 0;
+#ifdef DICT_STRING_STATS
+    mutable std::array<stats_shard_t, stats_shard_count> stats_shards_;
+#endif
 };
 
 // Dictionary string.
 class literal_dictionary::string {
     const literal_dictionary_node& get_node() const {
-        return *(reinterpret_cast<const literal_dictionary_node*>(str_) - 1);
+        return *reinterpret_cast<const literal_dictionary_node*>(
+            str_ - literal_dictionary_node::header_size);
     }
     friend class literal_dictionary;
-    string(const literal_dictionary_node* node) noexcept : str_(node->data()) {
+    string(const literal_dictionary_node* node) noexcept
+        : str_(node_str(node)) {
     }
 
 public:
     using size_type = string_view::size_type;
 
+#ifdef DICT_STRING_INLINE
+    // Maximum inline string size (tag byte and terminator don't fit).
+    static constexpr size_t inline_capacity = sizeof(const char*) - 2;
+#else
+    static constexpr size_t inline_capacity = 0;
+#endif
+
     constexpr string() noexcept : str_{literal_dictionary::empty_str()} {
     }
     constexpr string(const string& rhs) noexcept : str_(rhs.str_) {
     }
-    string(string_view rhs) : str_(literal_dictionary::add_global_str(rhs)) {
+    string(string_view rhs) : str_(global_str(rhs)) {
+    }
+    string(const char* rhs) : str_(global_str({rhs})) {
     }
-    string(const char* rhs) : str_(literal_dictionary::add_global_str({rhs})) {
+    // Add string to specified dictionary (canonical form of its key
+    // policy is kept).
+    string(literal_dictionary& dict, string_view rhs) : string(dict.add(rhs)) {
     }
     string& operator=(const string& rhs) noexcept {
         str_ = rhs.str_;
         return *this;
     }
     string& operator=(const string_view& rhs) {
-        str_ = literal_dictionary::add_global_str(rhs);
+        str_ = global_str(rhs);
         return *this;
     }
     string& operator=(const char* rhs) {
-        str_ = literal_dictionary::add_global_str(rhs);
+        str_ = global_str(rhs);
         return *this;
     }
     void clear() noexcept {
         str_ = literal_dictionary::empty_str();
     }
+    // Inline string (doesn't refer to dictionary).
+    bool is_inline() const noexcept {
+        return inline_capacity != 0
+            && (reinterpret_cast<uintptr_t>(str_) & 1) != 0;
+    }
     size_t hash() const noexcept {
-        return get_node().hash;
+        return is_inline() ? dict_hash(ref()) : get_node().hash();
     }
     const char* data() const noexcept {
-        return str_;
+        return is_inline() ? reinterpret_cast<const char*>(&str_) + 1 : str_;
     }
     const char* c_str() const noexcept {
-        return str_;
+        return data();
     }
     size_type size() const noexcept {
-        return get_node().size;
+        return is_inline()
+            ? static_cast<unsigned char>(*reinterpret_cast<const char*>(&str_))
+                >> 1
+            : get_node().size();
     }
+    // Inline strings are never empty (and their value isn't a pointer).
     bool empty() const noexcept {
-        return *str_ == 0;
+        return !is_inline() && *str_ == 0;
     }
     string_view ref() const noexcept {
-        return {str_, size()};
+        return {data(), size()};
     }
     operator string_view() const noexcept {
         return ref();
@@ -217,8 +1049,40 @@ public:
     int compare(const string& rhs) const noexcept {
         return ref().compare(rhs.ref());
     }
+    // Identity check, valid for strings from the same dictionary only.
+    bool identical(const string& rhs) const noexcept {
+        return str_ == rhs.str_;
+    }
 
 private:
+    static constexpr bool is_inline_size(size_t size) noexcept {
+        return size != 0 && size <= inline_capacity;
+    }
+    // Inline string value: tag byte, chars and zero padding.
+    static const char* inline_str(string_view str) noexcept {
+        char bytes[sizeof(const char*)] = {};
+        bytes[0] = static_cast<char>(str.size() << 1 | 1);
+        std::char_traits<char>::copy(bytes + 1, str.data(), str.size());
+        const char* value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+    static string make_inline(string_view str) noexcept {
+        string result;
+        result.str_ = inline_str(str);
+        return result;
+    }
+    static const char* global_str(string_view str) {
+        return is_inline_size(str.size())
+            ? inline_str(str)
+            : literal_dictionary::add_global_str(str);
+    }
+    // Short node strings are always inline, so equal strings are identical.
+    static const char* node_str(const literal_dictionary_node* node) noexcept {
+        return is_inline_size(node->size()) ? inline_str(node->str())
+                                          : node->data();
+    }
+
     const char* str_;
 };
 
@@ -243,13 +1107,18 @@ inline bool operator>=(
     const dict_string& lhs, const dict_string& rhs) noexcept {
     return lhs.ref() >= rhs.ref();
 }
+// Strings from the same dictionary (and inline strings) are unique,
+// so equal strings are identical. Content is compared only for strings
+// with equal hash which may come from different dictionary instances.
 inline bool operator==(
     const dict_string& lhs, const dict_string& rhs) noexcept {
-    return lhs.ref() == rhs.ref();
+    return lhs.identical(rhs)
+        || (!lhs.is_inline() && !rhs.is_inline() && lhs.hash() == rhs.hash()
+            && bits::equal(lhs.ref(), rhs.ref()));
 }
 inline bool operator!=(
     const dict_string& lhs, const dict_string& rhs) noexcept {
-    return lhs.ref() != rhs.ref();
+    return !(lhs == rhs);
 }
 
 inline bool operator<(const dict_string& lhs, const string_view& rhs) noexcept {
@@ -268,18 +1137,18 @@ inline bool operator>=(
 }
 inline bool operator==(
     const dict_string& lhs, const string_view& rhs) noexcept {
-    return lhs.ref() == rhs;
+    return bits::equal(lhs.ref(), rhs);
 }
 inline bool operator!=(
     const dict_string& lhs, const string_view& rhs) noexcept {
-    return lhs.ref() != rhs;
+    return !bits::equal(lhs.ref(), rhs);
 }
 
 inline bool operator==(const dict_string& lhs, const char* rhs) noexcept {
-    return lhs.ref() == string_view(rhs);
+    return bits::equal(lhs.ref(), rhs);
 }
 inline bool operator!=(const dict_string& lhs, const char* rhs) noexcept {
-    return lhs.ref() != string_view(rhs);
+    return !bits::equal(lhs.ref(), rhs);
 }
 
 inline bool operator<(const string_view& lhs, const dict_string& rhs) noexcept {
@@ -298,13 +1167,64 @@ inline bool operator>=(
 }
 inline bool operator==(
     const string_view& lhs, const dict_string& rhs) noexcept {
-    return lhs == rhs.ref();
+    return bits::equal(lhs, rhs.ref());
 }
 inline bool operator!=(
     const string_view& lhs, const dict_string& rhs) noexcept {
-    return lhs != rhs.ref();
+    return !bits::equal(lhs, rhs.ref());
 }
 
+// Identity based equality for strings from the same dictionary.
+// Suitable for hashed containers keyed by strings of one dictionary
+// (opt in explicitly). Equal strings from different dictionary instances
+// are not identical: use dict_string_equal for such containers.
+struct dict_string_identity_equal {
+    using is_transparent = void;
+    bool operator()(const dict_string& lhs, const dict_string& rhs) const
+        noexcept {
+        return lhs.identical(rhs);
+    }
+    bool operator()(const dict_string& lhs, const string_view& rhs) const
+        noexcept {
+        return bits::equal(lhs.ref(), rhs);
+    }
+    bool operator()(const string_view& lhs, const dict_string& rhs) const
+        noexcept {
+        return bits::equal(lhs, rhs.ref());
+    }
+};
+
+// Content based equality, with identity fast path (agrees with
+// operator==, default for std::equal_to<dict_string>).
+struct dict_string_equal {
+    using is_transparent = void;
+    bool operator()(const dict_string& lhs, const dict_string& rhs) const
+        noexcept {
+        return lhs == rhs;
+    }
+    bool operator()(const dict_string& lhs, const string_view& rhs) const
+        noexcept {
+        return bits::equal(lhs.ref(), rhs);
+    }
+    bool operator()(const string_view& lhs, const dict_string& rhs) const
+        noexcept {
+        return bits::equal(lhs, rhs.ref());
+    }
+};
+
+// Transparent hash: string views are hashed with dictionary hash function,
+// so hashed containers keyed by dict_string are searched by string_view
+// without adding it to dictionary (C++20 heterogeneous lookup).
+struct dict_string_hash {
+    using is_transparent = void;
+    size_t operator()(const dict_string& v) const noexcept {
+        return v.hash();
+    }
+    size_t operator()(const string_view& v) const noexcept {
+        return dict_hash(v);
+    }
+};
+
 // Dictionary iteration.
 class literal_dictionary::iterator {
 public:
@@ -327,18 +1247,101 @@ public:
         return bucket_position_;
     }
     size_t hash() const {
-        return node_->hash;
+        return node_->hash();
     }
 
 private:
     const literal_dictionary* dict_;
     const node_t* node_ = nullptr;
-    const dictionary_segment* segment_ = nullptr;
     const dictionary_segment* last_segment_ = nullptr;
+    // Current base layer node id (0 for table nodes).
+    size_t base_id_ = 0;
     size_t position_ = 0;
     size_t bucket_position_ = 0;
 };
 
+// Dictionary strings range for partitioned iteration.
+class literal_dictionary::range {
+    friend class literal_dictionary;
+    range(
+        const literal_dictionary* dict, const dictionary_segment* segment,
+        size_t bucket_begin, size_t bucket_end, size_t base_begin,
+        size_t base_end)
+        : dict_(dict)
+        , segment_(segment)
+        , bucket_begin_(bucket_begin)
+        , bucket_end_(bucket_end)
+        , base_begin_(base_begin)
+        , base_end_(base_end) {
+    }
+
+public:
+    // Visit range strings with fn(string).
+    template<class Fn>
+    void for_each(Fn&& fn) const {
+        for(auto id = base_begin_; id < base_end_; ++id)
+            fn(string{dict_->base_node(id + 1)});
+        if(segment_ == nullptr)
+            return;
+        auto table_size = segment_->table_size;
+        for(auto bucket_num = bucket_begin_; bucket_num < bucket_end_;
+            ++bucket_num) {
+            for(const auto* node =
+                    dict_->bucket_first_node(segment_, bucket_num);
+                node != nullptr
+                && bits::bucket_index(node->hash(), table_size) == bucket_num;
+                node = dict_->next_node(node))
+                fn(string{node});
+        }
+    }
+
+private:
+    const literal_dictionary* dict_;
+    const dictionary_segment* segment_;
+    size_t bucket_begin_;
+    size_t bucket_end_;
+    size_t base_begin_;
+    size_t base_end_;
+};
+
+template<class Fn>
+void literal_dictionary::parallel_for_each(
+    size_t thread_count, Fn&& fn) const {
+    auto parts = ranges(thread_count);
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < parts.size(); ++i)
+        threads.emplace_back([&fn, &part = parts[i]] { part.for_each(fn); });
+    parts[0].for_each(fn);
+    for(auto& thread : threads)
+        thread.join();
+}
+
+template<class Fn>
+void literal_dictionary::for_each_page_order(Fn&& fn) const {
+    constexpr uintptr_t node_align = std::alignment_of<node_t>::value;
+    for(size_t id = 1, count = base_count(); id <= count; ++id)
+        fn(string{base_node(id)});
+    for(const auto* page = first_page(); page != nullptr; page = page->next) {
+        auto pos = reinterpret_cast<uintptr_t>(page + 1);
+        auto end = reinterpret_cast<uintptr_t>(page)
+            + page->used.load(std::memory_order_acquire);
+        if(page->large) {
+            if(pos < end)
+                fn(string{reinterpret_cast<const node_t*>(
+                    pos + node_t::max_size_prefix)});
+            continue;
+        }
+        // Regular pages nodes have no size prefix.
+        while(pos < end) {
+            // Nodes are aligned as on allocation.
+            pos = (pos + node_align - 1) & ~(node_align - 1);
+            const auto* node = reinterpret_cast<const node_t*>(pos);
+            fn(string{node});
+            pos += node_t::node_size(node->size());
+        }
+    }
+}
+
 inline literal_dictionary::iterator literal_dictionary::begin() const {
     auto it = iterator(this);
     ++it;
@@ -348,6 +1351,103 @@ inline literal_dictionary::iterator literal_dictionary::end() const {
     return iterator(this);
 }
 
+namespace bits {
+
+// String key normalized by dictionary key policy: the string itself if
+// it is canonical already, otherwise normalized copy (on stack for keys
+// up to stack buffer size).
+class normalized_key {
+public:
+    using key_policy = literal_dictionary::key_policy;
+
+    normalized_key(key_policy policy, string_view str) : str_(str) {
+        if(policy == key_policy::exact || !bits::has_ascii_upper(str))
+            return;
+        auto* data = buffer_.data();
+        if(str.size() > buffer_.size()) {
+            heap_buffer_.reset(new char[str.size()]);
+            data = heap_buffer_.get();
+        }
+        bits::ascii_fold(str, data);
+        str_ = string_view(data, str.size());
+        normalized_ = true;
+    }
+    normalized_key(const normalized_key&) = delete;
+    normalized_key& operator=(const normalized_key&) = delete;
+
+    string_view str() const noexcept {
+        return str_;
+    }
+    // Key differs from the source string.
+    bool normalized() const noexcept {
+        return normalized_;
+    }
+
+private:
+    std::array<char, 256> buffer_;
+    std::unique_ptr<char[]> heap_buffer_;
+    string_view str_;
+    bool normalized_ = false;
+};
+
+} // namespace bits
+
+// Compile-time hash of string literal (run-time with DICT_STRING_STD_HASH).
+#ifdef DICT_STRING_STD_HASH
+#define DICT_STRING_LITERAL_HASH(str) ::utils::dict_hash(str)
+#else
+#define DICT_STRING_LITERAL_HASH(str) \
+    std::integral_constant<uint64_t, ::utils::dict_hash(str)>::value
+#endif
+
+// Global dictionary string for literal, resolved once per call site:
+//   DICT_STRING_LITERAL("user_id")
+#define DICT_STRING_LITERAL(str)                                       \
+    ([]() -> const ::utils::dict_string& {                             \
+        static const ::utils::dict_string dict_str =                   \
+            ::utils::literal_dictionary::global().add_hashed(          \
+                DICT_STRING_LITERAL_HASH(str), str);                   \
+        return dict_str;                                               \
+    }())
+
+namespace bits {
+
+// String literal characters as a type.
+template<char... Chars>
+struct string_literal {
+    static constexpr char data[] = {Chars..., '\0'};
+    static constexpr string_view str() {
+        return {data, sizeof...(Chars)};
+    }
+};
+
+} // namespace bits
+
+// Global dictionary string literals: "user_id"_ds.
+// String literal operator templates are a GNU extension (supported by GCC
+// and Clang), use DICT_STRING_LITERAL macro with other compilers.
+// Each literal is resolved once (literal function static).
+#if defined(__GNUC__)
+namespace literals {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#if defined(__clang__)
+#pragma GCC diagnostic ignored "-Wgnu-string-literal-operator-template"
+#endif
+template<class CharT, CharT... Chars>
+const dict_string& operator""_ds() {
+    static_assert(
+        std::is_same<CharT, char>::value, "only char literals are supported");
+    using literal = bits::string_literal<Chars...>;
+    static const dict_string dict_str =
+        literal_dictionary::global().add_hashed(
+            DICT_STRING_LITERAL_HASH(literal::str()), literal::str());
+    return dict_str;
+}
+#pragma GCC diagnostic pop
+} // namespace literals
+#endif
+
 } // namespace utils
 
 namespace std {
@@ -358,4 +1458,6 @@ struct hash<utils::dict_string> {
         return v.hash();
     }
 };
+template<>
+struct equal_to<utils::dict_string> : utils::dict_string_equal {};
 } // namespace std
@@ -0,0 +1,362 @@
+// Copyright (c) 2018 Dmitry Sokolov
+//
+// Distributed under the Boost Software License, Version 1.0. (See accompanying
+// file LICENSE or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Dictionary benchmarks, results are printed as JSON.
+//
+// Usage: shared_string_benchmark [--size N] [--threads N] [--out file]
+//   --size     number of distinct strings (default 2^20, up to 10^8)
+//   --threads  max number of threads (default hardware concurrency)
+//   --out      JSON output file (default stdout)
+//
+// Keys are generated from their index on the fly (key generation time is
+// included in all results, baselines included), so large dictionaries
+// don't need source strings in memory.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "shared_string.hpp"
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// Results kept observable: summed per thread (no shared cache line in
+// measured loops) and published once per benchmark thread.
+thread_local size_t thread_sink_sum = 0;
+std::atomic<size_t> sink_sum{0};
+
+struct benchmark_options {
+    size_t size = size_t(1) << 20;
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string out;
+};
+
+// Deterministic unique keys: index digits padded with pseudo-random
+// uppercase chars (padding never looks like digits).
+class key_generator {
+public:
+    static constexpr size_t max_length = 1024;
+
+    key_generator(size_t min_length, size_t max_length_, uint64_t seed = 0)
+        : min_length_(min_length)
+        , length_range_(max_length_ - min_length + 1)
+        , seed_(seed) {
+    }
+
+    utils::string_view operator()(uint64_t i, char* buf) const {
+        static constexpr char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+        auto h = utils::bits::mix64(i ^ seed_, 0x9E3779B97F4A7C15ull);
+        size_t length = min_length_ + h % length_range_;
+        size_t pos = 0;
+        do {
+            buf[pos++] = digits[i % 36];
+            i /= 36;
+        } while(i != 0);
+        for(; pos < length; ++pos) {
+            h = utils::bits::mix64(h, pos + 0x60BEE2BEE120FC15ull);
+            buf[pos] = static_cast<char>('A' + h % 26);
+        }
+        return {buf, pos};
+    }
+
+private:
+    size_t min_length_;
+    size_t length_range_;
+    uint64_t seed_;
+};
+
+// Benchmark result: name, parameters and metrics.
+struct result_t {
+    std::string name;
+    std::vector<std::pair<std::string, double>> values;
+};
+
+class benchmark_runner {
+public:
+    explicit benchmark_runner(const benchmark_options& opts) : opts_(opts) {
+    }
+
+    // Run function on threads, returns wall clock seconds.
+    template<class Func>
+    static double run_threads(size_t thread_count, Func&& func) {
+        std::atomic<bool> start{false};
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&start, &func, t] {
+                while(!start.load())
+                    std::this_thread::yield();
+                func(t);
+                sink_sum.fetch_add(thread_sink_sum, std::memory_order_relaxed);
+            });
+        }
+        auto t1 = clock_type::now();
+        start.store(true);
+        for(auto& thread : threads)
+            thread.join();
+        return std::chrono::duration<double>(clock_type::now() - t1).count();
+    }
+
+    // Thread counts: powers of two up to max threads.
+    std::vector<size_t> thread_counts() const {
+        std::vector<size_t> counts;
+        for(size_t t = 1; t < opts_.max_threads; t <<= 1)
+            counts.push_back(t);
+        counts.push_back(opts_.max_threads);
+        return counts;
+    }
+
+    void add_result(
+        std::string name, size_t threads, size_t ops, double seconds,
+        std::vector<std::pair<std::string, double>> extra = {}) {
+        result_t result{std::move(name), {}};
+        result.values.emplace_back("threads", double(threads));
+        result.values.emplace_back("operations", double(ops));
+        result.values.emplace_back("seconds", seconds);
+        result.values.emplace_back("ops_per_sec", ops / seconds);
+        result.values.emplace_back("ns_per_op", seconds * 1e9 / ops);
+        result.values.insert(result.values.end(), extra.begin(), extra.end());
+        std::cerr << result.name << " threads=" << threads << ": "
+                  << ops / seconds / 1e6 << " Mops/s\n";
+        results_.push_back(std::move(result));
+    }
+
+    // Add keys [0, size) partitioned between threads.
+    template<class Intern>
+    double intern_keys(
+        size_t thread_count, size_t size, const key_generator& keys,
+        Intern&& intern) {
+        return run_threads(thread_count, [&](size_t t) {
+            char buf[key_generator::max_length];
+            size_t end = size * (t + 1) / thread_count;
+            for(size_t i = size * t / thread_count; i < end; ++i)
+                intern(keys(i, buf));
+        });
+    }
+
+    // Cold (new strings) and warm (existing strings) intern throughput.
+    void intern_throughput() {
+        key_generator keys(4, 32);
+        for(auto thread_count : thread_counts()) {
+            utils::literal_dictionary dict;
+            auto intern = [&dict](utils::string_view str) {
+                sink(dict.add(str).data());
+            };
+            add_result(
+                "intern_cold", thread_count, opts_.size,
+                intern_keys(thread_count, opts_.size, keys, intern));
+            add_result(
+                "intern_warm", thread_count, opts_.size,
+                intern_keys(thread_count, opts_.size, keys, intern));
+        }
+    }
+
+    // Lookup throughput for hit ratios (missing keys are never added).
+    void lookup_hit_ratio() {
+        key_generator keys(4, 32);
+        utils::literal_dictionary dict;
+        intern_keys(
+            opts_.max_threads, opts_.size, keys,
+            [&dict](utils::string_view str) { dict.add(str); });
+        for(size_t hit_percent : {0, 50, 90, 100}) {
+            auto seconds = run_threads(opts_.max_threads, [&](size_t t) {
+                char buf[key_generator::max_length];
+                auto size = opts_.size;
+                size_t end = size * (t + 1) / opts_.max_threads;
+                for(size_t i = size * t / opts_.max_threads; i < end; ++i) {
+                    bool hit = utils::bits::mix64(i, 0x2545F4914F6CDD1Dull)
+                            % 100
+                        < hit_percent;
+                    // Missing keys are indexes past dictionary size.
+                    sink(dict.find(keys(hit ? i : i + size, buf)).has_value());
+                }
+            });
+            add_result(
+                "lookup", opts_.max_threads, opts_.size, seconds,
+                {{"hit_ratio", hit_percent / 100.0}});
+        }
+    }
+
+    // Cold intern throughput for string lengths.
+    void string_length() {
+        for(size_t length : {8, 32, 128, 512}) {
+            key_generator keys(length, length);
+            utils::literal_dictionary dict;
+            auto seconds = intern_keys(
+                opts_.max_threads, opts_.size, keys,
+                [&dict](utils::string_view str) {
+                    sink(dict.add(str).data());
+                });
+            add_result(
+                "intern_length", opts_.max_threads, opts_.size, seconds,
+                {{"length", double(length)}});
+        }
+    }
+
+    // Single thread add latency percentiles (table growth pauses are in
+    // the tail).
+    void growth_latency() {
+        key_generator keys(4, 32);
+        utils::literal_dictionary::options dict_opts;
+        dict_opts.table_initial_size =
+            utils::literal_dictionary::min_table_initial_size;
+        utils::literal_dictionary dict(dict_opts);
+        std::vector<uint32_t> latency(opts_.size);
+        char buf[key_generator::max_length];
+        auto t1 = clock_type::now();
+        for(size_t i = 0; i < opts_.size; ++i) {
+            auto str = keys(i, buf);
+            auto start = clock_type::now();
+            sink(dict.add(str).data());
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          clock_type::now() - start)
+                          .count();
+            latency[i] =
+                static_cast<uint32_t>(std::min<int64_t>(ns, UINT32_MAX));
+        }
+        auto seconds =
+            std::chrono::duration<double>(clock_type::now() - t1).count();
+        std::sort(latency.begin(), latency.end());
+        auto percentile = [&latency](double p) {
+            auto pos = static_cast<size_t>(p * (latency.size() - 1));
+            return double(latency[pos]);
+        };
+        add_result(
+            "add_latency_ns", 1, opts_.size, seconds,
+            {{"p50", percentile(0.5)},
+             {"p99", percentile(0.99)},
+             {"p999", percentile(0.999)},
+             {"max", double(latency.back())}});
+    }
+
+    // Baselines: std::unordered_set (single thread) and mutex protected
+    // std::unordered_set (intern from threads).
+    void baselines() {
+        key_generator keys(4, 32);
+        {
+            std::unordered_set<std::string> set;
+            auto intern = [&set](utils::string_view str) {
+                sink(set.emplace(str).first->data());
+            };
+            add_result(
+                "std_unordered_set_cold", 1, opts_.size,
+                intern_keys(1, opts_.size, keys, intern));
+            add_result(
+                "std_unordered_set_warm", 1, opts_.size,
+                intern_keys(1, opts_.size, keys, intern));
+        }
+        for(auto thread_count : thread_counts()) {
+            std::unordered_set<std::string> set;
+            std::mutex mtx;
+            auto intern = [&set, &mtx](utils::string_view str) {
+                std::lock_guard<std::mutex> lock(mtx);
+                sink(set.emplace(str).first->data());
+            };
+            add_result(
+                "mutex_unordered_set_cold", thread_count, opts_.size,
+                intern_keys(thread_count, opts_.size, keys, intern));
+            add_result(
+                "mutex_unordered_set_warm", thread_count, opts_.size,
+                intern_keys(thread_count, opts_.size, keys, intern));
+        }
+    }
+
+    void write_json(std::ostream& os) const {
+        os << "{\n  \"context\": {\"size\": " << opts_.size
+           << ", \"max_threads\": " << opts_.max_threads
+           << ", \"inline_strings\": "
+           << (utils::dict_string::inline_capacity != 0 ? "true" : "false")
+           << "},\n  \"benchmarks\": [";
+        for(size_t i = 0; i < results_.size(); ++i) {
+            const auto& result = results_[i];
+            os << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name
+               << '"';
+            for(const auto& value : result.values) {
+                os << ", \"" << value.first << "\": ";
+                write_json_number(os, value.second);
+            }
+            os << '}';
+        }
+        os << "\n  ]\n}\n";
+    }
+
+private:
+    // Counts are written as integers, other values with full precision
+    // (JSON has no infinity or NaN, null is written instead).
+    static void write_json_number(std::ostream& os, double value) {
+        if(!std::isfinite(value))
+            os << "null";
+        else if(value == std::floor(value) && std::fabs(value) < 0x1p53)
+            os << static_cast<int64_t>(value);
+        else {
+            auto precision = os.precision(17);
+            os << value;
+            os.precision(precision);
+        }
+    }
+
+    // Keep results observable (thread local sum, see run_threads).
+    template<class T>
+    static void sink(const T& value) {
+        thread_sink_sum += size_t(value);
+    }
+    static void sink(const char* value) {
+        sink(reinterpret_cast<uintptr_t>(value));
+    }
+
+    const benchmark_options opts_;
+    std::vector<result_t> results_;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    benchmark_options opts;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if(arg == "--size")
+            opts.size = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--threads")
+            opts.max_threads = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--out")
+            opts.out = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << arg << '\n';
+            return 1;
+        }
+    }
+    if(opts.size == 0 || opts.max_threads == 0) {
+        std::cerr << "invalid size or threads\n";
+        return 1;
+    }
+    benchmark_runner runner(opts);
+    runner.intern_throughput();
+    runner.lookup_hit_ratio();
+    runner.string_length();
+    runner.growth_latency();
+    runner.baselines();
+    if(opts.out.empty())
+        runner.write_json(std::cout);
+    else {
+        std::ofstream os(opts.out);
+        runner.write_json(os);
+        if(!os) {
+            std::cerr << "can't write " << opts.out << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -1,13 +1,30 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
+#include "async_interner.hpp"
+#include "counted_dict_string.hpp"
+#include "dict_string_map.hpp"
+#include "dictionary_snapshot.hpp"
+#include "dictionary_tokenizer.hpp"
+#include "generational_dictionary.hpp"
+#include "huge_page_resource.hpp"
 #include "shared_string.hpp"
 
 std::string random_string(size_t length) {
@@ -46,7 +63,6 @@ bool check_dictionary_refill(const dictionary_source_t& dict) {
         result.reserve(dict.size());
     // fill dictionary in parallel
     std::array<std::thread, thread_count> threads;
-    auto t1 = std::chrono::high_resolution_clock::now();
     for(size_t i = 0; i < threads.size(); ++i) {
         auto& result = results[i];
         threads[i] = std::thread(
@@ -54,11 +70,6 @@ bool check_dictionary_refill(const dictionary_source_t& dict) {
     }
     for(auto& t : threads)
         t.join();
-    auto t2 = std::chrono::high_resolution_clock::now();
-    auto time_spent =
-        std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1)
-            .count();
-    std::cout << "dict fill time:" << time_spent << " seconds\n";
     // check all threads have same results
     for(size_t i = 0; i < dict.size(); ++i) {
         const auto& str = dict[i];
@@ -70,13 +81,1113 @@ bool check_dictionary_refill(const dictionary_source_t& dict) {
         for(size_t j = 0; j < dict.size(); ++j) {
             const auto& str1 = results[0][j];
             const auto& str2 = results[i][j];
-            EXPECT_EQ(str1.data(), str2.data());
+            EXPECT_EQ(str1.identical(str2), true);
             EXPECT_EQ(str1.size(), str2.size());
         }
     }
     return true;
 }
 
+bool check_dict_string_equality() {
+    utils::dict_string str1 = "equality";
+    utils::dict_string str2{std::string("equality")};
+    utils::dict_string str3 = "identity";
+    EXPECT_EQ(str1.identical(str2), true);
+    EXPECT_EQ(str1 == str2, true);
+    EXPECT_EQ(str1 != str3, true);
+    utils::dict_string_identity_equal identity_equal;
+    EXPECT_EQ(identity_equal(str1, str2), true);
+    EXPECT_EQ(identity_equal(str1, str3), false);
+    EXPECT_EQ(identity_equal(str1, std::string_view("equality")), true);
+    // std::equal_to agrees with operator== for other dictionary strings
+    utils::literal_dictionary dict;
+    utils::dict_string str4(dict, "equality");
+    std::equal_to<utils::dict_string> equal;
+    EXPECT_EQ(identity_equal(str1, str4), false);
+    EXPECT_EQ(equal(str1, str4), str1 == str4);
+    EXPECT_EQ(equal(str1, str4), true);
+    EXPECT_EQ(equal(str1, str3), false);
+    EXPECT_EQ(equal(str1, std::string_view("equality")), true);
+    std::unordered_set<utils::dict_string> strings{str1};
+    EXPECT_EQ(strings.count(str4), 1u);
+    return true;
+}
+
+bool check_inline_strings() {
+    utils::dict_string str1 = "GET";
+    utils::dict_string str2{std::string("GET")};
+    EXPECT_EQ(str1.is_inline(), utils::dict_string::inline_capacity >= 3);
+    EXPECT_EQ(str1.identical(str2), true);
+    EXPECT_EQ(str1.size(), 3u);
+    EXPECT_STREQ(str1.c_str(), "GET");
+    EXPECT_EQ(str1.hash(), utils::dict_hash("GET"));
+    auto& global = utils::literal_dictionary::global();
+    EXPECT_EQ(global.at(global.id(str1)).identical(str1), true);
+    utils::literal_dictionary dict;
+    utils::dict_string str3(dict, "GET");
+    EXPECT_EQ(str3 == str1, true);
+    EXPECT_EQ(dict.at(dict.id(str3)) == str1, true);
+    EXPECT_EQ(std::hash<utils::dict_string>()(str3), str1.hash());
+    // inline strings get ids of the dictionary asked
+    utils::literal_dictionary id_dict;
+    id_dict.add("first long string");
+    auto get = id_dict.add("GET");
+    EXPECT_STREQ(id_dict.at(id_dict.id(get)).c_str(), "GET");
+    // short strings around inline capacity behave as node strings
+    std::string source = "abcdefghijklmnop";
+    for(size_t size = 0; size <= utils::dict_string::inline_capacity + 2;
+        ++size) {
+        auto view = utils::string_view(source).substr(0, size);
+        utils::dict_string str(dict, view);
+        EXPECT_EQ(str.empty(), size == 0);
+        EXPECT_EQ(str.size(), size);
+        EXPECT_EQ(std::strlen(str.c_str()), size);
+        EXPECT_EQ(std::memcmp(str.data(), source.data(), size), 0);
+        EXPECT_EQ(str == view, true);
+        EXPECT_EQ(str == utils::dict_string(view), true);
+        EXPECT_EQ(str != source, size != source.size());
+        EXPECT_EQ(str < source, size < source.size());
+        EXPECT_EQ(str.compare(view), 0);
+        str.clear();
+        EXPECT_EQ(str.empty(), true);
+    }
+    return true;
+}
+
+bool check_dictionary_iteration(const dictionary_source_t& dict) {
+    // each dictionary string should be visited exactly once
+    std::unordered_set<utils::dict_string> visited;
+    const auto& global = utils::literal_dictionary::global();
+    for(auto i = global.begin(); i != global.end(); ++i)
+        EXPECT_EQ(visited.insert(*i).second, true);
+    for(const auto& str : dict) {
+        utils::dict_string dict_str{str};
+        // inline strings are not stored in dictionary
+        EXPECT_EQ(visited.count(dict_str), dict_str.is_inline() ? 0u : 1u);
+    }
+    return true;
+}
+
+bool check_dictionary_add_many(const dictionary_source_t& dict) {
+    // batch with new, existing, duplicate and empty strings
+    std::vector<std::string_view> source;
+    for(size_t i = 0; i < 200; ++i)
+        source.push_back(dict[i]);
+    std::vector<std::string> new_words;
+    for(size_t i = 0; i < 100; ++i)
+        new_words.push_back("batch word " + std::to_string(i % 50));
+    source.insert(source.end(), new_words.begin(), new_words.end());
+    source.push_back({});
+    std::vector<utils::dict_string> results(source.size());
+    utils::literal_dictionary::global().add_many(
+        source.data(), source.size(), results.data());
+    for(size_t i = 0; i < source.size(); ++i) {
+        utils::dict_string str{source[i]};
+        EXPECT_EQ(str.identical(results[i]), true);
+    }
+    return true;
+}
+
+bool check_dictionary_find(const dictionary_source_t& dict) {
+    auto& global = utils::literal_dictionary::global();
+    utils::dict_string str{dict[0]};
+    auto found = global.find(dict[0]);
+    EXPECT_EQ(found.has_value(), true);
+    EXPECT_EQ(found->identical(str), true);
+    EXPECT_EQ(global.find("never added string").has_value(), false);
+    EXPECT_EQ(global.find("never added string").has_value(), false);
+    std::array<std::string_view, 3> source{
+        dict[1], "never added string", std::string_view()};
+    std::array<std::optional<utils::dict_string>, 3> results;
+    EXPECT_EQ(global.find_many(source.data(), 3, results.data()), 2u);
+    EXPECT_EQ(results[0]->identical(utils::dict_string(dict[1])), true);
+    EXPECT_EQ(results[1].has_value(), false);
+    EXPECT_EQ(results[2]->empty(), true);
+    return true;
+}
+
+bool check_dict_string_map(const dictionary_source_t& dict) {
+    utils::literal_dictionary map_dict;
+    utils::dict_string_map<size_t> map;
+    for(size_t i = 0; i < 1000; ++i)
+        map[utils::dict_string(map_dict, dict[i])] = i;
+    auto dict_size = map_dict.size();
+    for(size_t i = 0; i < 1000; ++i) {
+        utils::string_view str = dict[i];
+        EXPECT_EQ(
+            utils::dict_string_hash{}(str),
+            utils::dict_string_hash{}(utils::dict_string(map_dict, str)));
+        auto it = map.find(str);
+        EXPECT_EQ(it != map.end(), true);
+        EXPECT_EQ(it->first == str, true);
+        EXPECT_EQ(map.find(it->first) == it, true);
+    }
+    // string view lookups don't add strings
+    EXPECT_EQ(map.contains("missing dict_string_map key"), false);
+    EXPECT_EQ(map_dict.size(), dict_size);
+    std::unordered_set<std::string> keys(dict.begin(), dict.begin() + 1000);
+    EXPECT_EQ(map.size(), keys.size());
+    size_t erased = 0;
+    for(size_t i = 0; i < 1000; i += 2)
+        erased += map.erase(utils::string_view(dict[i]));
+    EXPECT_EQ(map.size(), keys.size() - erased);
+    for(size_t i = 0; i < 1000; ++i) {
+        auto it = map.find(dict[i]);
+        if(it != map.end())
+            EXPECT_EQ(it->second % 2, 1u);
+    }
+    size_t count = 0;
+    for(const auto& value : map)
+        count += value.first == dict[value.second];
+    EXPECT_EQ(count, map.size());
+    return true;
+}
+
+bool check_string_literals() {
+    using namespace utils::literals;
+    auto literal = [] { return &"literal user_id"_ds; };
+    EXPECT_EQ(literal(), literal());
+    EXPECT_EQ(
+        literal()->identical(utils::dict_string("literal user_id")), true);
+    EXPECT_EQ("literal user_id"_ds.hash(), utils::dict_hash("literal user_id"));
+    EXPECT_EQ(
+        DICT_STRING_LITERAL("literal user_id").identical(*literal()), true);
+    EXPECT_EQ("ts"_ds == utils::dict_string("ts"), true);
+    EXPECT_EQ(""_ds.empty(), true);
+    return true;
+}
+
+bool check_dictionary_stats(const dictionary_source_t& dict) {
+    utils::literal_dictionary::options opts;
+    opts.table_initial_size = utils::literal_dictionary::min_table_initial_size;
+    utils::literal_dictionary stats_dict(opts);
+    for(const auto& str : dict)
+        utils::dict_string(stats_dict, str);
+    for(const auto& str : dict)
+        utils::dict_string(stats_dict, str);
+    auto stats = stats_dict.stats();
+    EXPECT_EQ(stats.node_pages_size > 0, true);
+    EXPECT_EQ(stats.table_size > 0, true);
+    EXPECT_EQ(stats.id_table_size > 0, true);
+    if(utils::literal_dictionary::stats_enabled) {
+        EXPECT_EQ(stats.inserts, stats_dict.size());
+        EXPECT_EQ(stats.hits >= stats_dict.size(), true);
+        // the first string is added without search (no table yet)
+        EXPECT_EQ(stats.misses() + 1 >= stats_dict.size(), true);
+        EXPECT_EQ(stats.growths > 0, true);
+        EXPECT_EQ(stats.max_probes > 0, true);
+        EXPECT_EQ(stats.page_waste_size < stats.node_pages_size, true);
+    }
+    else
+        EXPECT_EQ(stats.lookups, 0u);
+    return true;
+}
+
+bool check_dictionary_ranges(const dictionary_source_t& dict) {
+    utils::literal_dictionary range_dict;
+    for(const auto& str : dict)
+        utils::dict_string(range_dict, str);
+    // ranges are disjoint and cover all strings
+    std::unordered_set<utils::dict_string> strings;
+    size_t count = 0;
+    for(const auto& range : range_dict.ranges(7)) {
+        range.for_each([&](const utils::dict_string& str) {
+            strings.insert(str);
+            ++count;
+        });
+    }
+    EXPECT_EQ(count, range_dict.size());
+    EXPECT_EQ(strings.size(), range_dict.size());
+    std::atomic<size_t> parallel_count{0};
+    range_dict.parallel_for_each(4, [&](const utils::dict_string& str) {
+        if(str.size() != 0)
+            ++parallel_count;
+    });
+    EXPECT_EQ(parallel_count.load(), range_dict.size());
+    count = 0;
+    range_dict.for_each_page_order([&](const utils::dict_string& str) {
+        count += strings.count(str);
+    });
+    EXPECT_EQ(count, range_dict.size());
+    // scans beside inserting thread see inserted strings only
+    utils::literal_dictionary insert_dict;
+    std::atomic<bool> inserted{false};
+    std::thread inserter([&] {
+        for(size_t i = 0; i < 20000; ++i)
+            insert_dict.add("concurrent scan " + std::to_string(i));
+        inserted = true;
+    });
+    size_t invalid = 0;
+    auto check = [&](const utils::dict_string& str) {
+        if(!insert_dict.at(insert_dict.id(str)).identical(str))
+            ++invalid;
+    };
+    while(!inserted) {
+        insert_dict.for_each_page_order(check);
+        for(const auto& range : insert_dict.ranges(3))
+            range.for_each(check);
+    }
+    inserter.join();
+    EXPECT_EQ(invalid, 0u);
+    return true;
+}
+
+bool check_dictionary_instance() {
+    std::array<char, 256 * 1024> buffer;
+    utils::pmr::monotonic_buffer_resource mem(buffer.data(), buffer.size());
+    utils::literal_dictionary::options opts;
+    opts.table_initial_size = 1024;
+    utils::literal_dictionary dict(opts, &mem);
+    utils::dict_string global_str = "instance";
+    utils::dict_string str1(dict, "instance");
+    utils::dict_string str2 = dict.add("instance");
+    EXPECT_EQ(str1.identical(str2), true);
+    EXPECT_EQ(str1.identical(global_str), false);
+    EXPECT_EQ(str1 == global_str, true);
+    EXPECT_EQ(dict.find("lorem ipsum").has_value(), false);
+    size_t word_count = 0;
+    for(auto i = dict.begin(); i != dict.end(); ++i)
+        ++word_count;
+    EXPECT_EQ(word_count, 1u);
+    EXPECT_EQ(dict.max_string_size(), size_t(UINT32_MAX));
+    // former constant names are kept
+    using dictionary = utils::literal_dictionary;
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+    EXPECT_EQ(
+        dictionary::allocate_chunk_size,
+        dictionary::default_allocate_chunk_size);
+    EXPECT_EQ(
+        dictionary::table_initial_size, dictionary::default_table_initial_size);
+    constexpr size_t max_string_size = dictionary::max_string_size;
+    EXPECT_EQ(max_string_size, dictionary::max_string_size());
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+    return true;
+}
+
+bool check_thread_arena_reuse() {
+    constexpr size_t dict_count = 6;
+    utils::literal_dictionary::options opts;
+    opts.allocate_chunk_size =
+        utils::literal_dictionary::min_allocate_chunk_size;
+    std::vector<std::unique_ptr<utils::literal_dictionary>> dicts;
+    for(size_t i = 0; i < dict_count; ++i)
+        dicts.push_back(std::make_unique<utils::literal_dictionary>(opts));
+    // more dictionaries than cached thread arenas: evicted arenas are
+    // reused with their pages
+    for(size_t i = 0; i < 100; ++i) {
+        for(auto& dict : dicts)
+            dict->add("arena reuse string " + std::to_string(i));
+    }
+    // short-lived threads return their arenas on exit
+    for(size_t i = 0; i < 100; ++i) {
+        std::thread([&] {
+            dicts[0]->add("arena thread string " + std::to_string(i));
+        }).join();
+    }
+    for(auto& dict : dicts) {
+        EXPECT_EQ(
+            dict->stats().node_pages_size <= 4 * opts.allocate_chunk_size,
+            true);
+    }
+    // arenas of destroyed dictionary are dropped by threads
+    dicts.pop_back();
+    for(auto& dict : dicts)
+        dict->add("arena after destruction");
+    return true;
+}
+
+bool check_large_strings() {
+    utils::literal_dictionary::options opts;
+    opts.allocate_chunk_size =
+        utils::literal_dictionary::min_allocate_chunk_size;
+    utils::literal_dictionary dict(opts);
+    // Quarter chunk and larger strings get own chunks.
+    std::vector<std::string> source = {
+        std::string(1024, 'a'), std::string(100 * 1024, 'b'),
+        std::string(3 * 1024 * 1024, 'c')};
+    std::vector<utils::dict_string> strings;
+    for(auto& str : source) {
+        dict.add("small " + str.substr(0, 10));
+        strings.push_back(dict.add(str));
+    }
+    for(size_t i = 0; i < source.size(); ++i) {
+        EXPECT_EQ(dict.add(source[i]).identical(strings[i]), true);
+        EXPECT_EQ(dict.find(source[i])->identical(strings[i]), true);
+        EXPECT_EQ(strings[i].size(), source[i].size());
+        EXPECT_EQ(strings[i].c_str()[source[i].size()], '\0');
+    }
+    size_t count = 0;
+    dict.for_each_page_order([&](const utils::dict_string&) { ++count; });
+    EXPECT_EQ(count, 2 * source.size());
+    EXPECT_EQ(dict.stats().node_pages_size > 3 * 1024 * 1024, true);
+    // Snapshots keep large strings (compact nodes store their sizes
+    // before node header).
+    const char* path = "shared_string_test_large.snapshot";
+    dict.save_snapshot(path);
+    opts.snapshot_path = path;
+    utils::literal_dictionary loaded(opts);
+    std::remove(path);
+    std::vector<utils::string_view> views(source.begin(), source.end());
+    utils::snapshot_build_options build_opts;
+    build_opts.perfect_hash = true;
+    utils::literal_dictionary frozen(
+        utils::dictionary_snapshot::build(
+            views.data(), views.size(), build_opts),
+        utils::literal_dictionary::options{});
+    for(size_t i = 0; i < source.size(); ++i) {
+        EXPECT_EQ(
+            loaded.id(*loaded.find(source[i])), dict.id(strings[i]));
+        EXPECT_EQ(loaded.add(source[i]).size(), source[i].size());
+        EXPECT_EQ(frozen.id(*frozen.find(source[i])), i + 1);
+    }
+    return true;
+}
+
+bool check_lookup_cache(const dictionary_source_t& source) {
+    // long strings (not inline) go through the cache
+    dictionary_source_t dict;
+    for(const auto& str : source)
+        dict.push_back(str + " (lookup cache)");
+    utils::literal_dictionary::options opts;
+    opts.lookup_cache_size = 100;
+    // dictionaries replace each other caches, destroyed ones never match
+    for(int round = 0; round < 6; ++round) {
+        utils::literal_dictionary cached_dict(opts);
+        std::vector<utils::dict_string> strs;
+        for(const auto& str : dict)
+            strs.push_back(cached_dict.add(str));
+        auto size = cached_dict.size();
+        for(size_t i = 0; i < dict.size(); ++i) {
+            auto str = cached_dict.add(dict[i]);
+            EXPECT_EQ(str.identical(strs[i]), true);
+        }
+        // other thread cache is filled separately
+        bool thread_ok = true;
+        std::thread([&] {
+            for(size_t i = 0; i < dict.size(); ++i)
+                thread_ok &= cached_dict.add(dict[i]).identical(strs[i]);
+        }).join();
+        EXPECT_EQ(thread_ok, true);
+        EXPECT_EQ(cached_dict.size(), size);
+        auto stats = cached_dict.stats();
+        if(utils::literal_dictionary::stats_enabled) {
+            EXPECT_EQ(stats.cache_lookups, dict.size() * 3);
+            EXPECT_EQ(stats.cache_hits > 0, true);
+            EXPECT_EQ(stats.cache_hit_rate() <= 1, true);
+        }
+        else
+            EXPECT_EQ(stats.cache_lookups, 0u);
+    }
+    return true;
+}
+
+bool check_tagged_table(const dictionary_source_t& dict) {
+    utils::literal_dictionary::options opts;
+    opts.table_initial_size = 64;
+    opts.policy = utils::literal_dictionary::table_policy::tagged;
+    utils::literal_dictionary tagged(opts);
+    std::vector<utils::dict_string> strings;
+    for(const auto& str : dict)
+        strings.emplace_back(tagged, str);
+    for(size_t i = 0; i < dict.size(); ++i) {
+        auto found = tagged.find(dict[i]);
+        EXPECT_EQ(found.has_value(), true);
+        EXPECT_EQ(found->identical(strings[i]), true);
+        EXPECT_EQ(tagged.find(dict[i] + " missing").has_value(), false);
+    }
+    return true;
+}
+
+bool check_dictionary_ids() {
+    utils::literal_dictionary::options opts;
+    utils::literal_dictionary dict(opts);
+    EXPECT_EQ(dict.at(0).empty(), true);
+    std::vector<utils::dict_string> strings;
+    for(size_t i = 0; i < 10000; ++i)
+        strings.push_back(dict.add("dictionary id " + std::to_string(i)));
+    EXPECT_EQ(dict.size(), strings.size());
+    for(size_t i = 0; i < strings.size(); ++i) {
+        EXPECT_EQ(dict.id(strings[i]), i + 1);
+        EXPECT_EQ(
+            dict.at(dict.id(strings[i])).identical(strings[i]), true);
+    }
+    EXPECT_EQ(dict.id(dict.add("dictionary id 0")), 1u);
+    bool thrown = false;
+    try {
+        dict.at(static_cast<uint32_t>(strings.size() + 1));
+    } catch(const std::out_of_range&) {
+        thrown = true;
+    }
+    EXPECT_EQ(thrown, true);
+    return true;
+}
+
+bool check_dictionary_snapshot() {
+    const char* path = "shared_string_test.snapshot";
+    std::vector<std::string> source;
+    for(size_t i = 0; i < 5000; ++i)
+        source.push_back("snapshot " + std::to_string(i));
+    {
+        utils::literal_dictionary dict;
+        for(auto& str : source)
+            dict.add(str);
+        dict.save_snapshot(path);
+    }
+    utils::literal_dictionary::options opts;
+    opts.snapshot_path = path;
+    {
+        utils::literal_dictionary dict(opts);
+        EXPECT_EQ(dict.size(), source.size());
+        for(size_t i = 0; i < source.size(); ++i) {
+            auto str = dict.add(source[i]);
+            EXPECT_EQ(dict.id(str), i + 1);
+            EXPECT_STREQ(str.c_str(), source[i]);
+            EXPECT_EQ(dict.at(dict.id(str)).identical(str), true);
+            EXPECT_EQ(str.hash(), utils::dict_hash(source[i]));
+        }
+        EXPECT_EQ(dict.id(*dict.find("snapshot 100")), 101u);
+        EXPECT_EQ(dict.find("not in snapshot").has_value(), false);
+        auto added = dict.add("not in snapshot");
+        EXPECT_EQ(dict.id(added), source.size() + 1);
+        EXPECT_EQ(dict.add("not in snapshot").identical(added), true);
+        // id table covers added strings only
+        EXPECT_EQ(
+            dict.stats().id_table_size
+                <= utils::literal_dictionary::id_segment_initial_size
+                    * sizeof(void*),
+            true);
+        std::unordered_set<utils::dict_string> visited;
+        for(auto i = dict.begin(); i != dict.end(); ++i)
+            visited.insert(*i);
+        EXPECT_EQ(visited.size(), source.size() + 1);
+        size_t range_count = 0;
+        for(const auto& range : dict.ranges(3))
+            range.for_each([&](const utils::dict_string&) { ++range_count; });
+        EXPECT_EQ(range_count, source.size() + 1);
+        size_t page_count = 0;
+        dict.for_each_page_order([&](const utils::dict_string& str) {
+            page_count += visited.count(str);
+        });
+        EXPECT_EQ(page_count, source.size() + 1);
+        // Resave merges base layer and added strings.
+        dict.save_snapshot(path);
+    }
+    {
+        utils::literal_dictionary dict(opts);
+        EXPECT_EQ(dict.size(), source.size() + 1);
+        EXPECT_STREQ(dict.at(source.size() + 1).c_str(), "not in snapshot");
+    }
+    std::remove(path);
+    return true;
+}
+
+bool check_corrupt_snapshot() {
+    const char* path = "shared_string_test_corrupt.snapshot";
+    {
+        utils::literal_dictionary dict;
+        for(size_t i = 0; i < 20; ++i)
+            dict.add("corrupt snapshot " + std::to_string(i));
+        dict.add(std::string(100, 'c'));
+        dict.save_snapshot(path);
+    }
+    std::string contents;
+    {
+        std::ifstream is(path, std::ios::binary);
+        contents.assign(
+            std::istreambuf_iterator<char>(is),
+            std::istreambuf_iterator<char>());
+    }
+    auto load = [path](const std::string& data) {
+        {
+            std::ofstream os(path, std::ios::binary | std::ios::trunc);
+            os.write(data.data(), static_cast<std::streamsize>(data.size()));
+        }
+        try {
+            utils::dictionary_snapshot snapshot(path);
+            for(size_t id = 1; id <= snapshot.count(); ++id) {
+                const auto* node = snapshot.node(id);
+                snapshot.find(node->hash(), node->str());
+            }
+        } catch(const std::runtime_error&) {
+            return false;
+        }
+        return true;
+    };
+    EXPECT_EQ(load(contents), true);
+    EXPECT_EQ(load(contents.substr(0, contents.size() / 2)), false);
+    // Every word is overwritten with large value: buckets (32 + 1) and
+    // ids (21) words are rejected, other damage is rejected or harmless.
+    size_t rejected = 0;
+    for(size_t pos = 0; pos + 8 <= contents.size(); pos += 8) {
+        auto data = contents;
+        std::memset(&data[pos], 0x7F, 8);
+        rejected += load(data) ? 0 : 1;
+    }
+    std::remove(path);
+    EXPECT_EQ(rejected >= 33u + 21u, true);
+    return true;
+}
+
+bool check_frozen_dictionary() {
+    std::vector<std::string> source;
+    for(size_t i = 0; i < 5000; ++i)
+        source.push_back("frozen " + std::to_string(i % 3000));
+    source.emplace_back();
+    std::vector<utils::string_view> views(source.begin(), source.end());
+    for(bool perfect_hash : {false, true}) {
+        utils::snapshot_build_options build_opts;
+        build_opts.thread_count = 3;
+        build_opts.perfect_hash = perfect_hash;
+        auto snapshot = utils::dictionary_snapshot::build(
+            views.data(), views.size(), build_opts);
+        EXPECT_EQ(snapshot->count(), 3000u);
+        EXPECT_EQ(snapshot->has_perfect_hash(), perfect_hash);
+        utils::literal_dictionary dict(
+            std::move(snapshot), utils::literal_dictionary::options{});
+        EXPECT_EQ(dict.size(), 3000u);
+        for(size_t i = 0; i < source.size() - 1; ++i) {
+            auto str = dict.add(source[i]);
+            EXPECT_EQ(dict.id(str), i % 3000 + 1);
+            EXPECT_STREQ(str.c_str(), source[i]);
+            EXPECT_EQ(dict.find(source[i])->identical(str), true);
+            EXPECT_EQ(dict.at(dict.id(str)).identical(str), true);
+        }
+        EXPECT_EQ(dict.find("frozen 3000").has_value(), false);
+        auto added = dict.add("frozen 3000");
+        EXPECT_EQ(dict.id(added), 3001u);
+        EXPECT_EQ(dict.find("frozen 3000")->identical(added), true);
+        EXPECT_EQ(dict.size(), 3001u);
+    }
+    return true;
+}
+
+bool check_shared_snapshot() {
+    const char* name = "/shared_string_test";
+    {
+        utils::literal_dictionary dict;
+        dict.add("shared 1");
+        dict.add("shared 2");
+        dict.publish_shared(name);
+    }
+    utils::literal_dictionary::options opts;
+    opts.shared_snapshot_name = name;
+    utils::literal_dictionary dict1(opts);
+    utils::literal_dictionary dict2(opts);
+    utils::dictionary_snapshot::remove_shared(name);
+    // Both dictionaries use the same strings and ids.
+    EXPECT_EQ(dict1.id(dict1.add("shared 2")), 2u);
+    EXPECT_EQ(dict2.id(dict2.add("shared 2")), 2u);
+    EXPECT_EQ(dict1.id(dict1.add("local string")), 3u);
+    EXPECT_STREQ(dict2.at(1).c_str(), "shared 1");
+    EXPECT_EQ(dict2.find("local string").has_value(), false);
+    return true;
+}
+
+bool check_key_policy() {
+    utils::literal_dictionary::options opts;
+    opts.keys = utils::literal_dictionary::key_policy::ascii_icase;
+    utils::literal_dictionary dict(opts);
+    // canonical (lower case) form is kept
+    auto type = dict.add("Content-Type");
+    EXPECT_EQ(type.ref(), "content-type");
+    EXPECT_EQ(type.identical(dict.add("CONTENT-TYPE")), true);
+    EXPECT_EQ(type.identical(utils::dict_string(dict, "content-TYPE")), true);
+    EXPECT_EQ(dict.add("HOST").identical(dict.add("host")), true);
+    EXPECT_EQ(dict.find("Accept-Charset").has_value(), false);
+    auto accept = dict.add("accept-encoding");
+    EXPECT_EQ(dict.find("Accept-Encoding")->identical(accept), true);
+    EXPECT_EQ(dict.try_add("ACCEPT-ENCODING")->identical(accept), true);
+    // long keys are normalized on heap
+    std::string long_key(300, 'K');
+    auto long_str = dict.add(long_key);
+    EXPECT_EQ(long_str.ref(), std::string(300, 'k'));
+    EXPECT_EQ(long_str.identical(dict.add(std::string(300, 'k'))), true);
+    std::array<utils::string_view, 3> keys = {
+        "Content-type", "ACCEPT-encoding", long_key};
+    std::array<utils::dict_string, 3> strs;
+    dict.add_many(keys.data(), keys.size(), strs.data());
+    std::array<std::optional<utils::dict_string>, 3> found;
+    EXPECT_EQ(dict.find_many(keys.data(), keys.size(), found.data()), 3u);
+    EXPECT_EQ(strs[0].identical(type), true);
+    EXPECT_EQ(strs[1].identical(accept), true);
+    EXPECT_EQ(strs[2].identical(long_str), true);
+    EXPECT_EQ(found[2]->identical(long_str), true);
+    // only ASCII letters are folded (at any position of 8 bytes words)
+    std::string bytes;
+    for(int c = 1; c < 256; ++c)
+        bytes.push_back(static_cast<char>(c));
+    for(size_t pos = 0; pos < 8; ++pos) {
+        auto key = bytes.substr(pos);
+        auto expected = key;
+        for(auto& c : expected)
+            c = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        EXPECT_EQ(dict.add(key).ref() == expected, true);
+    }
+    // exact keys are kept as is
+    utils::literal_dictionary exact_dict;
+    EXPECT_EQ(exact_dict.add("Content-Type").ref(), "Content-Type");
+    EXPECT_EQ(
+        exact_dict.add("Content-Type").identical(
+            exact_dict.add("content-type")),
+        false);
+    // snapshots are normalized and keep key policy
+    std::array<utils::string_view, 4> base_keys = {
+        "Accept-Charset", "accept-charset", "X-Request-Id", "host"};
+    utils::snapshot_build_options build_opts;
+    build_opts.thread_count = 2;
+    build_opts.keys = opts.keys;
+    auto snapshot = utils::dictionary_snapshot::build(
+        base_keys.data(), base_keys.size(), build_opts);
+    EXPECT_EQ(snapshot->count(), 3u);
+    utils::literal_dictionary frozen(std::move(snapshot), opts);
+    EXPECT_EQ(frozen.id(frozen.add("ACCEPT-CHARSET")), 1u);
+    EXPECT_EQ(frozen.id(*frozen.find("x-request-id")), 2u);
+    EXPECT_STREQ(frozen.at(2).c_str(), "x-request-id");
+    bool thrown = false;
+    try {
+        utils::literal_dictionary mismatch(
+            utils::dictionary_snapshot::build(
+                base_keys.data(), base_keys.size(), build_opts),
+            utils::literal_dictionary::options{});
+    } catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    EXPECT_EQ(thrown, true);
+    const char* path = "shared_string_test_keys.snapshot";
+    dict.save_snapshot(path);
+    thrown = false;
+    try {
+        utils::literal_dictionary::options exact_opts;
+        exact_opts.snapshot_path = path;
+        utils::literal_dictionary mismatch(exact_opts);
+    } catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    EXPECT_EQ(thrown, true);
+    opts.snapshot_path = path;
+    utils::literal_dictionary loaded(opts);
+    std::remove(path);
+    EXPECT_EQ(loaded.id(*loaded.find("CONTENT-TYPE")), dict.id(type));
+    return true;
+}
+
+bool check_string_compare() {
+    // strings end their own allocations, so any read beyond the end
+    // is caught by address sanitizer
+    for(size_t size = 0; size <= 40; ++size) {
+        auto source = std::string(size, 'x');
+        std::unique_ptr<char[]> lhs(new char[size]);
+        std::unique_ptr<char[]> rhs(new char[size]);
+        std::copy_n(source.data(), size, lhs.get());
+        std::copy_n(source.data(), size, rhs.get());
+        EXPECT_EQ(utils::bits::equal(lhs.get(), rhs.get(), size), true);
+        EXPECT_EQ(utils::bits::equal(lhs.get(), source.data(), size), true);
+        for(size_t pos = 0; pos < size; ++pos) {
+            rhs[pos] = 'y';
+            EXPECT_EQ(utils::bits::equal(lhs.get(), rhs.get(), size), false);
+            rhs[pos] = 'x';
+        }
+    }
+    // external views are compared with dictionary strings by content
+    utils::literal_dictionary dict;
+    const char word[] = {'e', 'q', 'u', 'a', 'l', 'i', 't', 'y'};
+    auto str = dict.add("equality");
+    EXPECT_EQ(
+        utils::dict_string_identity_equal()(
+            str, utils::string_view(word, sizeof(word))),
+        true);
+    EXPECT_EQ(str == utils::string_view(word, sizeof(word) - 1), false);
+    return true;
+}
+
+// Memory resource counting allocated bytes (thread safe).
+class counting_resource : public utils::pmr::memory_resource {
+public:
+    size_t allocated = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        std::lock_guard<std::mutex> lock(mtx_);
+        allocated += bytes;
+        return utils::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        std::lock_guard<std::mutex> lock(mtx_);
+        allocated -= bytes;
+        utils::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const utils::pmr::memory_resource& other) const
+        noexcept override {
+        return this == &other;
+    }
+
+    std::mutex mtx_;
+};
+
+bool check_generational_dictionary() {
+    counting_resource mem;
+    {
+        utils::generational_dictionary dict(
+            utils::literal_dictionary::options{}, &mem);
+        auto pinned = dict.pin("permanent string");
+        size_t retired_size = 0;
+        {
+            utils::generational_dictionary::guard guard(dict);
+            auto str1 = dict.add("session token 1");
+            EXPECT_EQ(dict.add("session token 1").identical(str1), true);
+            EXPECT_EQ(dict.advance(), 2u);
+            // strings of live generations are reused
+            EXPECT_EQ(dict.add("session token 1").identical(str1), true);
+            EXPECT_EQ(dict.add("permanent string").identical(pinned), true);
+            dict.add("session token 2");
+            retired_size = mem.allocated;
+            EXPECT_EQ(dict.retire_oldest(), true);
+            // retired generation is kept while guard is active
+            EXPECT_EQ(dict.collect(), 0u);
+            EXPECT_STREQ(str1.c_str(), "session token 1");
+            EXPECT_EQ(dict.find("session token 1").has_value(), false);
+            EXPECT_EQ(dict.find("session token 2").has_value(), true);
+        }
+        EXPECT_EQ(dict.collect(), 1u);
+        EXPECT_EQ(dict.generation_count(), 1u);
+        EXPECT_EQ(dict.retire_oldest(), false);
+        EXPECT_EQ(mem.allocated < retired_size, true);
+        EXPECT_STREQ(pinned.c_str(), "permanent string");
+    }
+    EXPECT_EQ(mem.allocated, 0u);
+    // reader records of evicted slots and exited threads are reused
+    std::vector<std::unique_ptr<utils::generational_dictionary>> dicts;
+    for(size_t i = 0; i < 6; ++i)
+        dicts.push_back(std::make_unique<utils::generational_dictionary>());
+    for(size_t i = 0; i < 100; ++i) {
+        for(auto& dict : dicts)
+            dict->add("reader string " + std::to_string(i));
+    }
+    {
+        // active guard keeps evicted record in use
+        utils::generational_dictionary::guard guard(*dicts[0]);
+        for(size_t i = 1; i < dicts.size(); ++i)
+            dicts[i]->add("reader guard string");
+        dicts[0]->add("reader guard string");
+        EXPECT_EQ(dicts[0]->reader_count(), 2u);
+    }
+    for(size_t i = 0; i < 100; ++i) {
+        std::thread([&] {
+            dicts[0]->add("reader thread string " + std::to_string(i));
+        }).join();
+    }
+    for(auto& dict : dicts)
+        EXPECT_EQ(dict->reader_count() <= 2, true);
+    dicts.pop_back();
+    for(auto& dict : dicts)
+        dict->add("reader after destruction");
+    return true;
+}
+
+bool check_counted_strings() {
+    counting_resource mem;
+    {
+        utils::counted_dictionary dict(
+            utils::literal_dictionary::options{}, &mem);
+        auto str1 = dict.add("counted string 1");
+        auto str2 = dict.add("counted string 1");
+        EXPECT_EQ(str1.identical(str2), true);
+        EXPECT_EQ(str1.use_count(), 2u);
+        EXPECT_STREQ(str1.c_str(), "counted string 1");
+        EXPECT_EQ(str1 == "counted string 1", true);
+        EXPECT_EQ(dict.size(), 1u);
+        const void* data = str1.data();
+        str2.reset();
+        {
+            auto copy = str1;
+            EXPECT_EQ(str1.use_count(), 2u);
+        }
+        str1.reset();
+        // string is removed with the last reference
+        EXPECT_EQ(dict.size(), 0u);
+        EXPECT_EQ(dict.find("counted string 1").has_value(), false);
+        // node memory is reused by strings of the same size class
+        // (from the same lock stripe)
+        constexpr auto stripe_count = utils::counted_dictionary::stripe_count;
+        std::string other;
+        for(size_t i = 2; other.empty(); ++i) {
+            auto str = "counted string " + std::to_string(i);
+            if(utils::dict_hash(str) % stripe_count
+               == utils::dict_hash("counted string 1") % stripe_count)
+                other = str;
+        }
+        auto str3 = dict.add(other);
+        EXPECT_EQ(static_cast<const void*>(str3.data()), data);
+        str3.reset();
+
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&dict] {
+                for(size_t i = 0; i < 10000; ++i) {
+                    auto str =
+                        dict.add("counted string " + std::to_string(i % 100));
+                    auto copy = str;
+                }
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        EXPECT_EQ(dict.size(), 0u);
+
+        // lock-free lookups during insertion, removal and growth
+        auto pinned = dict.add("counted string pinned");
+        std::atomic<size_t> misses{0};
+        threads.clear();
+        for(size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&dict, &misses, t] {
+                for(size_t i = 0; i < 20000; ++i) {
+                    if(t % 2 == 0) {
+                        auto str = dict.add(
+                            "counted string " + std::to_string(t * i % 5000));
+                        continue;
+                    }
+                    auto found = dict.find("counted string pinned");
+                    if(!found || *found != "counted string pinned")
+                        ++misses;
+                }
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        EXPECT_EQ(misses.load(), 0u);
+        pinned.reset();
+        EXPECT_EQ(dict.size(), 0u);
+
+        // removed nodes are reused under continuous lookups (of the same
+        // lock stripe)
+        auto kept = dict.add("counted string kept");
+        std::vector<std::string> churn;
+        for(size_t i = 0; churn.size() < 8; ++i) {
+            auto str = "counted churn " + std::to_string(i);
+            if(utils::dict_hash(str) % stripe_count
+               == kept.hash() % stripe_count)
+                churn.push_back(str);
+        }
+        std::atomic<size_t> started{0};
+        std::atomic<bool> done{false};
+        threads.clear();
+        for(size_t t = 0; t < 2; ++t) {
+            threads.emplace_back([&] {
+                // reader record is allocated by the first lookup
+                dict.find(kept);
+                ++started;
+                while(!done.load()) {
+                    if(!dict.find(kept))
+                        ++misses;
+                }
+            });
+        }
+        while(started.load() < threads.size())
+            std::this_thread::yield();
+        // (preempted lookups delay reclamation, so readers may run on a
+        // single core too)
+        size_t allocated = 0;
+        for(size_t i = 0; i < 100000; ++i) {
+            dict.add(churn[i % churn.size()]);
+            if(i % 100 == 0)
+                std::this_thread::yield();
+            if(i == 10000)
+                allocated = mem.allocated;
+        }
+        auto churn_allocated = mem.allocated - allocated;
+        done = true;
+        for(auto& thread : threads)
+            thread.join();
+        EXPECT_EQ(misses.load(), 0u);
+        // no reuse would take 100 chunks
+        EXPECT_EQ(
+            churn_allocated
+                <= 2 * utils::literal_dictionary::default_allocate_chunk_size,
+            true);
+    }
+    EXPECT_EQ(mem.allocated, 0u);
+    {
+        auto opts = utils::literal_dictionary::options{};
+        opts.keys = utils::literal_dictionary::key_policy::ascii_icase;
+        utils::counted_dictionary dict(opts);
+        auto str = dict.add("Content-Type");
+        EXPECT_STREQ(str.c_str(), "content-type");
+        EXPECT_EQ(dict.add("CONTENT-TYPE").identical(str), true);
+        EXPECT_EQ(dict.find("content-TYPE").has_value(), true);
+        EXPECT_EQ(dict.size(), 1u);
+    }
+    return true;
+}
+
+bool check_async_interner(const dictionary_source_t& source) {
+    utils::literal_dictionary dict;
+    EXPECT_EQ(dict.try_add(source[0])->identical(dict.add(source[0])), true);
+    EXPECT_EQ(dict.try_add("").has_value(), true);
+    {
+        // ids claimed without waiting are never skipped
+        utils::literal_dictionary try_dict;
+        std::atomic<bool> mismatch{false};
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                for(size_t i = 0; i < 20000; ++i) {
+                    auto str = "try add " + std::to_string(i);
+                    auto found = try_dict.try_add(str);
+                    if(found && *found != str)
+                        mismatch = true;
+                }
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        EXPECT_EQ(mismatch.load(), false);
+        for(size_t id = 1; id <= try_dict.size(); ++id)
+            EXPECT_EQ(try_dict.id(try_dict.at(id)), id);
+    }
+    std::vector<std::vector<utils::async_interner::result>> results(4);
+    {
+        utils::async_interner interner(dict);
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < results.size(); ++t) {
+            threads.emplace_back([&, t] {
+                for(const auto& str : source)
+                    results[t].push_back(interner.add(str));
+            });
+        }
+        for(auto& thread : threads)
+            thread.join();
+        interner.flush();
+        EXPECT_EQ(interner.pending(), 0u);
+        // found strings are not queued
+        EXPECT_EQ(interner.add(source[0]).queued(), false);
+        for(size_t i = 0; i < source.size(); ++i) {
+            auto str = results[0][i].get();
+            EXPECT_STREQ(str.c_str(), source[i]);
+            EXPECT_EQ(str == dict.add(source[i]), true);
+            for(size_t t = 1; t < results.size(); ++t)
+                EXPECT_EQ(results[t][i].get().identical(str), true);
+        }
+        // Requests queued on destruction are completed.
+        results[0].clear();
+        for(size_t i = 0; i < 100; ++i)
+            results[0].push_back(
+                interner.add("async pending " + std::to_string(i)));
+    }
+    for(size_t i = 0; i < 100; ++i) {
+        EXPECT_STREQ(
+            results[0][i].get().c_str(),
+            "async pending " + std::to_string(i));
+    }
+    // Strings submitted while stopping are added as well.
+    for(size_t round = 0; round < 20; ++round) {
+        utils::async_interner interner(dict);
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < results.size(); ++t) {
+            results[t].clear();
+            threads.emplace_back([&, t, round] {
+                for(size_t i = 0; i < 200; ++i)
+                    results[t].push_back(interner.add(
+                        "async stop " + std::to_string(round * 1000 + i)));
+            });
+        }
+        interner.stop();
+        for(auto& thread : threads)
+            thread.join();
+        for(size_t t = 0; t < results.size(); ++t) {
+            for(size_t i = 0; i < results[t].size(); ++i) {
+                auto& result = results[t][i];
+                EXPECT_EQ(result.ready(), true);
+                EXPECT_STREQ(
+                    result.get().c_str(),
+                    "async stop " + std::to_string(round * 1000 + i));
+            }
+        }
+        EXPECT_EQ(interner.pending(), 0u);
+    }
+    return true;
+}
+
+bool check_dictionary_tokenizer(const dictionary_source_t& source) {
+    // tokens cross 64 bytes blocks, delimiters are repeated
+    std::string text = "  ";
+    for(size_t i = 0; i < 1000; ++i) {
+        text += source[i];
+        text += i % 7 == 0 ? "\t\r\n" : " ";
+    }
+    text += std::string(200, 'x');
+    auto words = [](const std::string& str) {
+        std::istringstream iss(str);
+        return std::vector<std::string>(
+            std::istream_iterator<std::string>{iss},
+            std::istream_iterator<std::string>());
+    };
+    auto expected = words(text);
+    utils::literal_dictionary dict;
+    utils::dictionary_tokenizer tokenizer(dict);
+    std::vector<utils::dict_string> tokens;
+    tokenizer.tokenize(text, tokens);
+    EXPECT_EQ(tokens.size(), expected.size());
+    for(size_t i = 0; i < tokens.size(); ++i)
+        EXPECT_EQ(tokens[i].ref(), expected[i]);
+    std::vector<uint32_t> ids;
+    tokenizer.tokenize_ids(text, ids);
+    EXPECT_EQ(ids.size(), tokens.size());
+    for(size_t i = 0; i < ids.size(); ++i)
+        EXPECT_EQ(dict.at(ids[i]).ref(), tokens[i].ref());
+    // each input tail size (partial last block)
+    for(size_t size = 0; size <= 130; ++size) {
+        auto part = text.substr(0, size);
+        std::vector<utils::dict_string> part_tokens;
+        tokenizer.tokenize(part, part_tokens);
+        auto part_words = words(part);
+        EXPECT_EQ(part_tokens.size(), part_words.size());
+        for(size_t i = 0; i < part_tokens.size(); ++i)
+            EXPECT_EQ(part_tokens[i].ref(), part_words[i]);
+    }
+    // large delimiter sets are classified by table lookup
+    std::string delimiters = " \t\r\n,;:|";
+    utils::dictionary_tokenizer table_tokenizer(dict, delimiters);
+    std::string csv = ",a;bb|ccc::" + std::string(100, 'd') + ";e,";
+    std::vector<utils::dict_string> fields;
+    table_tokenizer.tokenize(csv, fields);
+    EXPECT_EQ(fields.size(), 5u);
+    EXPECT_EQ(fields[0].ref(), "a");
+    EXPECT_EQ(fields[3].ref(), std::string(100, 'd'));
+    EXPECT_EQ(fields[4].ref(), "e");
+    return true;
+}
+
+bool check_huge_page_dictionary(const dictionary_source_t& dict) {
+    utils::huge_page_memory_resource mem;
+    utils::literal_dictionary::options opts;
+    opts.allocate_chunk_size = utils::huge_page_memory_resource::page_size_2m;
+    utils::literal_dictionary huge_dict(opts, &mem);
+    for(const auto& str : dict) {
+        utils::dict_string dict_str(huge_dict, str);
+        EXPECT_STREQ(dict_str.data(), str);
+    }
+    EXPECT_EQ(mem.mapped_size() > 0, true);
+    if(!utils::huge_page_memory_resource::supported())
+        return true;
+    // freed small allocations are reused by the same size class
+    auto* block = mem.allocate(1000, 8);
+    mem.deallocate(block, 1000, 8);
+    EXPECT_EQ(mem.allocate(1024, 8), block);
+    auto mapped_size = mem.mapped_size();
+    for(size_t i = 0; i < 100; ++i) {
+        auto* page = mem.allocate(opts.allocate_chunk_size, 64);
+        mem.deallocate(page, opts.allocate_chunk_size, 64);
+    }
+    auto region_size = utils::huge_page_memory_resource::options{}.region_size;
+    EXPECT_EQ(mem.mapped_size() <= mapped_size + region_size, true);
+    return true;
+}
+
 // Print dictionary content.
 void print_dictionary(const utils::literal_dictionary& dict) {
     size_t word_count = 0;
@@ -117,8 +1228,24 @@ int main() {
     std::generate_n(dict.begin(), dict_size, [word_size] {
         return random_string(1 + (rand() % word_size));
     });
-    bool ok = check_dictionary_refill(dict) && check_dictionary_refill(dict)
-        && check_dictionary_refill(dict);
+    bool ok = check_dict_string_equality() && check_inline_strings()
+        && check_string_literals()
+        && check_dictionary_instance() && check_thread_arena_reuse()
+        && check_large_strings()
+        && check_dictionary_refill(dict)
+        && check_dictionary_refill(dict) && check_dictionary_refill(dict)
+        && check_dictionary_add_many(dict) && check_dictionary_find(dict)
+        && check_dict_string_map(dict) && check_dictionary_stats(dict)
+        && check_lookup_cache(dict)
+        && check_dictionary_ranges(dict)
+        && check_dictionary_iteration(dict) && check_dictionary_ids()
+        && check_tagged_table(dict) && check_dictionary_snapshot()
+        && check_corrupt_snapshot() && check_frozen_dictionary()
+        && check_shared_snapshot() && check_key_policy()
+        && check_string_compare()
+        && check_generational_dictionary() && check_counted_strings()
+        && check_async_interner(dict) && check_huge_page_dictionary(dict)
+        && check_dictionary_tokenizer(dict);
 
     return ok ? 0 : -1;
 }